@@ -2,18 +2,26 @@
 
 #include "Array2d.hpp"
 
-template<typename T>
-void fillCircle(Array2d<T>& mat, Vec2T<i64> center, i64 radius, const T& value) {
-	const auto minX = std::clamp(center.x - radius, 0ll, mat.size().x - 1);
-	const auto maxX = std::clamp(center.x + radius, 0ll, mat.size().x - 1);
-	const auto minY = std::clamp(center.y - radius, 0ll, mat.size().y - 1);
-	const auto maxY = std::clamp(center.y + radius, 0ll, mat.size().y - 1);
+// Calls function(x, y) for each cell of a gridSize grid inside the circle.
+template<typename Function>
+void forEachCellInCircle(Vec2T<i64> gridSize, Vec2T<i64> center, i64 radius, Function function) {
+	const auto minX = std::clamp(center.x - radius, 0ll, gridSize.x - 1);
+	const auto maxX = std::clamp(center.x + radius, 0ll, gridSize.x - 1);
+	const auto minY = std::clamp(center.y - radius, 0ll, gridSize.y - 1);
+	const auto maxY = std::clamp(center.y + radius, 0ll, gridSize.y - 1);
 
 	for (i64 x = minX; x <= maxX; x++) {
 		for (i64 y = minY; y <= maxY; y++) {
 			if (Vec2(center).distanceTo(Vec2(x, y)) < radius) {
-				mat(x, y) = value;
+				function(x, y);
 			}
 		}
 	}
+}
+
+template<typename T>
+void fillCircle(Array2d<T>& mat, Vec2T<i64> center, i64 radius, const T& value) {
+	forEachCellInCircle(mat.size(), center, radius, [&](i64 x, i64 y) {
+		mat(x, y) = value;
+	});
 };
\ No newline at end of file
@@ -3,11 +3,11 @@
 #include <engine/Math/Aabb.hpp>
 
 namespace Constants {
-	constexpr f32 CELL_SIZE = 0.1f;
+	constexpr f32 DEFAULT_CELL_SIZE = 0.1f;
 	constexpr Vec2T<i64> DEFAULT_GRID_SIZE(320, 200);
 	constexpr f32 CAMERA_SPEED = 10.0f;
 	constexpr f32 EMITTER_DISPLAY_RADIUS = 0.25f;
 	constexpr f32 REVOLUTE_JOINT_DISPLAY_RADIUS = 0.25f;
 
-	Aabb gridBounds(Vec2T<i64> gridSize);
+	Aabb gridBounds(Vec2T<i64> gridSize, f32 cellSize);
 };
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include <game/CpuFeatures.hpp>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+const char* instructionSetName(InstructionSet instructionSet) {
+	switch (instructionSet) {
+		using enum InstructionSet;
+	case SCALAR: return "scalar";
+	case SSE4_2: return "SSE4.2";
+	case AVX2: return "AVX2";
+	case AVX512: return "AVX-512";
+	}
+	return "";
+}
+
+static CpuFeatures detectCpuFeatures() {
+	CpuFeatures features{
+		.sse4_2 = false,
+		.avx2 = false,
+		.fma = false,
+		.f16c = false,
+		.avx512f = false,
+	};
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	auto bit = [](int value, int index) {
+		return ((value >> index) & 1) != 0;
+	};
+
+	int info[4];
+	__cpuid(info, 0);
+	const auto maxLeaf = info[0];
+	if (maxLeaf < 1) {
+		return features;
+	}
+
+	__cpuid(info, 1);
+	features.sse4_2 = bit(info[2], 20);
+	const auto fma = bit(info[2], 12);
+	const auto osxsave = bit(info[2], 27);
+	const auto avx = bit(info[2], 28);
+	const auto f16c = bit(info[2], 29);
+
+	// XCR0 tells which register states the operating system saves on context switches.
+	const auto xcr0 = osxsave ? _xgetbv(0) : 0;
+	const auto ymmSaved = (xcr0 & 0x06) == 0x06;
+	const auto zmmSaved = (xcr0 & 0xe6) == 0xe6;
+
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		features.avx2 = avx && ymmSaved && bit(info[1], 5);
+		features.avx512f = zmmSaved && bit(info[1], 16);
+	}
+	features.fma = fma && ymmSaved;
+	features.f16c = f16c && ymmSaved;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+	// Also checks if the operating system saves the registers.
+	__builtin_cpu_init();
+	features.sse4_2 = __builtin_cpu_supports("sse4.2");
+	features.avx2 = __builtin_cpu_supports("avx2");
+	features.fma = __builtin_cpu_supports("fma");
+	features.f16c = __builtin_cpu_supports("f16c");
+	features.avx512f = __builtin_cpu_supports("avx512f");
+#endif
+
+	return features;
+}
+
+const CpuFeatures& cpuFeatures() {
+	static const auto features = detectCpuFeatures();
+	return features;
+}
+
+bool isInstructionSetSupported(InstructionSet instructionSet) {
+	const auto& features = cpuFeatures();
+	switch (instructionSet) {
+		using enum InstructionSet;
+	case SCALAR: return true;
+	case SSE4_2: return features.sse4_2;
+	case AVX2: return features.avx2 && features.fma && features.f16c;
+	// The AVX-512 kernels are compiled with AVX2, FMA and F16C enabled too, but every cpu with AVX-512F has them.
+	case AVX512: return features.avx512f;
+	}
+	return false;
+}
+
+InstructionSet bestSupportedInstructionSet() {
+	using enum InstructionSet;
+	if (isInstructionSetSupported(AVX512)) {
+		return AVX512;
+	}
+	if (isInstructionSetSupported(AVX2)) {
+		return AVX2;
+	}
+	if (isInstructionSetSupported(SSE4_2)) {
+		return SSE4_2;
+	}
+	return SCALAR;
+}
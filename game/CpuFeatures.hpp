@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Types.hpp>
+
+enum class InstructionSet {
+	SCALAR,
+	SSE4_2,
+	AVX2,
+	AVX512,
+};
+
+const char* instructionSetName(InstructionSet instructionSet);
+
+struct CpuFeatures {
+	// Only set if the operating system also saves the registers the instructions use.
+	bool sse4_2;
+	bool avx2;
+	bool fma;
+	bool f16c;
+	bool avx512f;
+};
+
+// Detected with cpuid the first time it's called.
+const CpuFeatures& cpuFeatures();
+InstructionSet bestSupportedInstructionSet();
+bool isInstructionSetSupported(InstructionSet instructionSet);
@@ -21,6 +21,7 @@
 #include <glad/glad.h>
 #include <Json/JsonPrinter.hpp>
 #include <fstream>
+#include <cmath>
 
 const auto ELLIPSE_SAMPLE_POINTS = 70;
 const auto PARABOLA_SAMPLE_POINTS = 70;
@@ -31,7 +32,7 @@ Editor Editor::make() {
 		.polygonTool = PolygonTool::make(),
 		.shapeBooleanOperationsTool = ShapeBooleanOperationsTool::make(),
 		.gizmoSelectedShapesAtGrabStart = List<EditorShape>::empty(),
-		.roomBounds = Constants::gridBounds(Constants::DEFAULT_GRID_SIZE),
+		.roomBounds = Constants::gridBounds(Constants::DEFAULT_GRID_SIZE, Constants::DEFAULT_CELL_SIZE),
 		.simulationSettings = SimulationSettings::makeDefault(),
 		.actions = EditorActions::make(),
 		.polygonShapes = decltype(polygonShapes)::make(),
@@ -510,6 +511,7 @@ Editor::Result Editor::gui() {
 	ImGui::Begin(editorSimulationSettingsWindowName);
 	simulationSettingsGui(simulationSettings);
 	ImGui::End();
+	roomBounds = Constants::gridBounds(Vec2T<i64>(simulationSettings.gridSize.x, simulationSettings.gridSize.y), simulationSettings.cellSize);
 
 	bool switchToSimulation = false;
 	ImGui::Begin(editorEditorSettingsWindowName);
@@ -588,7 +590,7 @@ Editor::Result Editor::gui() {
 			ImGui::SeparatorText("line");
 			if (gameBeginPropertyEditor("lineSettings")) {
 				Gui::inputFloat("width", lineTool.width);
-				lineTool.width = std::max(Constants::CELL_SIZE * 2, lineTool.width);
+				lineTool.width = std::max(simulationSettings.cellSize * 2, lineTool.width);
 
 				Gui::endPropertyEditor();
 			}
@@ -712,10 +714,16 @@ void Editor::entityGui(EditorEntityId id) {
 			if (body->material.type == EditorMaterialType::TRANSIMISIVE && oldMaterialType != EditorMaterialType::TRANSIMISIVE) {
 				body->material.transimisive = materialTransimisiveSetting;
 			}
+			if (body->material.type == EditorMaterialType::DAMPING && oldMaterialType != EditorMaterialType::DAMPING) {
+				body->material.damping = materialDampingSetting;
+			}
 
 			if (body->material.type == EditorMaterialType::TRANSIMISIVE) {
 				modificationFinished |= transmissiveMaterialGui(body->material.transimisive);
 			}
+			if (body->material.type == EditorMaterialType::DAMPING) {
+				modificationFinished |= dampingMaterialGui(body->material.damping);
+			}
 			Gui::endPropertyEditor();
 		}
 		Gui::popPropertyEditor();
@@ -803,9 +811,13 @@ void Editor::render(GameRenderer& renderer, const GameInput& input) {
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	renderer.drawBounds(roomBounds);
+	if (simulationSettings.fitGridToLevel && !simulationFollowsCamera(simulationSettings)) {
+		const auto domain = fittedSimulationGridDomain(simulationSettings, levelBounds());
+		renderer.drawBounds(Aabb(domain.origin, domain.origin + Vec2(f32(domain.size.x), f32(domain.size.y)) * simulationSettings.cellSize), Color3::GREEN);
+	}
 
 	auto materialTypeToColor = [](EditorMaterialType materialType, Vec3 color) -> Vec4 {
-		if (materialType == EditorMaterialType::TRANSIMISIVE) {
+		if (materialType == EditorMaterialType::TRANSIMISIVE || materialType == EditorMaterialType::DAMPING) {
 			return Vec4(color, GameRenderer::transimittingShapeTransparency);
 		}
 		return Vec4(color, 0.85f);
@@ -1129,6 +1141,34 @@ Aabb Editor::editorShapeAabb(const EditorShape& shape) const {
 	return Aabb(Vec2(0.0f), Vec2(0.0f));
 }
 
+std::optional<Aabb> Editor::levelBounds() const {
+	std::optional<Aabb> result;
+	auto add = [&result](Aabb aabb) {
+		if (!result.has_value()) {
+			result = aabb;
+			return;
+		}
+		result->min = Vec2(std::min(result->min.x, aabb.min.x), std::min(result->min.y, aabb.min.y));
+		result->max = Vec2(std::max(result->max.x, aabb.max.x), std::max(result->max.y, aabb.max.y));
+	};
+	for (const auto& body : rigidBodies) {
+		add(editorShapeAabb(body->shape));
+	}
+	for (const auto& emitter : emitters) {
+		add(circleAabb(getEmitterPosition(emitter.entity), Constants::EMITTER_DISPLAY_RADIUS));
+	}
+	// Only the room is simulated.
+	if (!result.has_value()) {
+		return result;
+	}
+	const auto min = Vec2(std::max(result->min.x, roomBounds.min.x), std::max(result->min.y, roomBounds.min.y));
+	const auto max = Vec2(std::min(result->max.x, roomBounds.max.x), std::min(result->max.y, roomBounds.max.y));
+	if (min.x > max.x || min.y > max.y) {
+		return std::nullopt;
+	}
+	return Aabb(min, max);
+}
+
 bool Editor::isEditorShapeContainedInAabb(const EditorShape& shape, const Aabb& aabb) const {
 	// shape contained in aabb <=> shape's aabb contained in aabb.
 	// <= because shape is a subset of shape's aabb which is a subset of aabb
@@ -1412,6 +1452,9 @@ EditorMaterial Editor::materialSetting() const {
 
 	case TRANSIMISIVE:
 		return EditorMaterial(materialTransimisiveSetting);
+
+	case DAMPING:
+		return EditorMaterial(materialDampingSetting);
 	}
 
 	CHECK_NOT_REACHED();
@@ -1435,6 +1478,13 @@ void Editor::materialSettingGui() {
 		}
 		Gui::popPropertyEditor();
 		break;
+	case DAMPING:
+		if (gameBeginPropertyEditor("dampingSettings")) {
+			dampingMaterialGui(materialDampingSetting);
+			Gui::endPropertyEditor();
+		}
+		Gui::popPropertyEditor();
+		break;
 	}
 }
 
@@ -1452,6 +1502,13 @@ bool Editor::transmissiveMaterialGui(EditorMaterialTransimisive& material) {
 	return modified;
 }
 
+bool Editor::dampingMaterialGui(EditorMaterialDamping& material) {
+	Gui::inputFloat("damping", material.damping);
+	const auto modified = ImGui::IsItemDeactivatedAfterEdit();
+	material.damping = std::max(material.damping, 0.0f);
+	return modified;
+}
+
 bool Editor::collisionGui(u32& collisionCategories, u32& collisionMask) {
 	auto bitMaskGui = [](u32& mask) -> bool {
 		bool modificationFinished = false;
@@ -2447,6 +2504,10 @@ static LevelMaterial levelMaterial(const EditorMaterial& material) {
 			.matchBackgroundSpeedOfTransmission = material.transimisive.matchBackgroundSpeedOfTransmission,
 			.speedOfTransmition = material.transimisive.speedOfTransmition
 		};
+	case DAMPING:
+		return LevelMaterialDamping{
+			.damping = material.damping.damping
+		};
 	}
 	ASSERT_NOT_REACHED();
 }
@@ -2483,9 +2544,16 @@ LevelShape Editor::levelShape(const EditorShape& shape) {
 const auto rigidBodiesFieldName = "rigidBodies";
 const auto emittersFieldName = "emitters";
 const auto revoluteJointsFieldName = "revoluteJoints";
+const auto gridFieldName = "grid";
 
 std::optional<Json::Value> Editor::saveLevel() {
 	auto level = Json::Value::emptyObject();
+	level[gridFieldName] = toJson(LevelGrid{
+		.cellCountX = simulationSettings.gridSize.x,
+		.cellCountY = simulationSettings.gridSize.y,
+		.cellSize = simulationSettings.cellSize,
+	});
+
 	std::unordered_map<EditorRigidBodyId, i32> rigidBodyIdToIndex;
 	{
 		auto& levelRigidBodies = (level[rigidBodiesFieldName] = Json::Value::emptyArray()).array();
@@ -2622,6 +2690,14 @@ std::optional<EditorMaterial> Editor::materialFromLevel(const LevelMaterial& mat
 				.speedOfTransmition = material.speedOfTransmition
 			});
 		},
+		[](const LevelMaterialDamping& material) -> std::optional<EditorMaterial> {
+			if (!std::isfinite(material.damping) || material.damping < 0.0f) {
+				return std::nullopt;
+			}
+			return EditorMaterial(EditorMaterialDamping{
+				.damping = material.damping
+			});
+		},
 	}, material);
 }
 
@@ -2661,6 +2737,28 @@ bool Editor::tryLoadLevel(const char* path) {
 	try {
 		reset();
 
+		{
+			// The levels saved before the grid was stored use the default one.
+			const auto defaultSettings = SimulationSettings::makeDefault();
+			simulationSettings.gridSize = defaultSettings.gridSize;
+			simulationSettings.cellSize = defaultSettings.cellSize;
+			std::optional<LevelGrid> grid;
+			try {
+				grid = fromJson<LevelGrid>(json->at(gridFieldName));
+			} catch (const Json::Value::Exception&) {}
+
+			if (grid.has_value()) {
+				auto isValidCellCount = [](i32 count) {
+					return count >= MIN_SIMULATION_GRID_SIZE && count <= MAX_SIMULATION_GRID_SIZE;
+				};
+				if (!isValidCellCount(grid->cellCountX) || !isValidCellCount(grid->cellCountY) || !(grid->cellSize >= MIN_SIMULATION_CELL_SIZE && grid->cellSize <= MAX_SIMULATION_CELL_SIZE)) {
+					goto failedToLoadLevel;
+				}
+				simulationSettings.gridSize = Vec2T<i32>(grid->cellCountX, grid->cellCountY);
+				simulationSettings.cellSize = grid->cellSize;
+			}
+		}
+
 		std::unordered_map<i32, EditorRigidBodyId> rigidBodyIndexToId;
 		{
 			auto& rigidBodiesJson = json->at(rigidBodiesFieldName).array();
@@ -148,6 +148,9 @@ struct Editor {
 		.matchBackgroundSpeedOfTransmission = false,
 		.speedOfTransmition = 1.0f, 
 	};
+	EditorMaterialDamping materialDampingSetting = EditorMaterialDamping{
+		.damping = 10.0f,
+	};
 	bool isStaticSetting = false;
 
 	// Not sure if this is the best way to achieve this, but I want everything to collide with the ground regardless of category.
@@ -164,6 +167,7 @@ struct Editor {
 	EditorMaterial materialSetting() const;
 	void materialSettingGui();
 	bool transmissiveMaterialGui(EditorMaterialTransimisive& material);
+	bool dampingMaterialGui(EditorMaterialDamping& material);
 	static bool collisionGui(u32& collisionCategories, u32& collisionMask);
 	void rigidBodyGui();
 
@@ -273,6 +277,8 @@ struct Editor {
 	EditorShape cloneShape(const EditorShape& shape);
 
 	Aabb editorShapeAabb(const EditorShape& shape) const;
+	// The bounds of the rigid bodies and the emitters inside the room. nullopt if there are none.
+	std::optional<Aabb> levelBounds() const;
 	bool isEditorShapeContainedInAabb(const EditorShape& shape, const Aabb& aabb) const;
 	bool isPointInEditorShape(const EditorShape& shape, Vec2 point) const;
 
@@ -132,6 +132,10 @@ EditorMaterial::EditorMaterial(const EditorMaterialTransimisive& material)
 	: transimisive(material) 
 	, type(EditorMaterialType::TRANSIMISIVE) {}
 
+EditorMaterial::EditorMaterial(const EditorMaterialDamping& material)
+	: damping(material)
+	, type(EditorMaterialType::DAMPING) {}
+
 EditorMaterial EditorMaterial::makeReflecting() {
 	return EditorMaterial(EditorMaterialType::RELFECTING);
 }
@@ -152,6 +156,10 @@ bool EditorMaterial::operator==(const EditorMaterial& other) const {
 		return transimisive == other.transimisive;
 		break;
 
+	case DAMPING:
+		return damping == other.damping;
+		break;
+
 	}
 	CHECK_NOT_REACHED();
 	return false;
@@ -184,6 +192,7 @@ const char* editorMaterialTypeName(EditorMaterialType material) {
 		using enum EditorMaterialType;
 	case RELFECTING: return "reflecting";
 	case TRANSIMISIVE: return "transmissive";
+	case DAMPING: return "damping";
 	}
 	CHECK_NOT_REACHED();
 	return "";
@@ -193,6 +202,7 @@ bool materialTypeComboGui(EditorMaterialType& selectedType) {
 	EditorMaterialType types[]{
 		EditorMaterialType::RELFECTING,
 		EditorMaterialType::TRANSIMISIVE,
+		EditorMaterialType::DAMPING,
 	};
 	const char* preview = editorMaterialTypeName(selectedType);
 
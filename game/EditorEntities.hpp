@@ -64,7 +64,8 @@ struct EditorShape {
 
 enum class EditorMaterialType {
 	RELFECTING,
-	TRANSIMISIVE
+	TRANSIMISIVE,
+	DAMPING
 };
 
 const char* editorMaterialTypeName(EditorMaterialType material);
@@ -77,13 +78,23 @@ struct EditorMaterialTransimisive {
 	bool operator==(const EditorMaterialTransimisive&) const = default;
 };
 
+// Absorbs the waves passing through it.
+struct EditorMaterialDamping {
+	// The velocity decays as exp(-damping * t) inside.
+	f32 damping;
+
+	bool operator==(const EditorMaterialDamping&) const = default;
+};
+
 struct EditorMaterial {
 	union {
 		EditorMaterialTransimisive transimisive;
+		EditorMaterialDamping damping;
 	};
 	EditorMaterialType type;
 
 	EditorMaterial(const EditorMaterialTransimisive& material);
+	EditorMaterial(const EditorMaterialDamping& material);
 	static EditorMaterial makeReflecting();
 
 	bool operator==(const EditorMaterial& other) const;
@@ -35,7 +35,11 @@ GameRenderer GameRenderer::make() {
 Vec3 selectedColor = Color3::WHITE;
 
 void GameRenderer::drawBounds(Aabb aabb) {
-	gfx.rect(aabb.min, aabb.size(), 0.01f / gfx.camera.zoom, Color3::WHITE);
+	drawBounds(aabb, Color3::WHITE);
+}
+
+void GameRenderer::drawBounds(Aabb aabb, Vec3 color) {
+	gfx.rect(aabb.min, aabb.size(), 0.01f / gfx.camera.zoom, color);
 	gfx.drawLines();
 }
 
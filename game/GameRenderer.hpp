@@ -6,6 +6,7 @@ struct GameRenderer {
 	static GameRenderer make();
 
 	void drawBounds(Aabb aabb);
+	void drawBounds(Aabb aabb, Vec3 color);
 	void disk(Vec2 center, f32 radius, f32 angle, Vec4 color, Vec3 outlineColor, bool isStatic);
 	void polygon(const List<Vec2>& vertices, const List<i32>& boundary, const List<i32>& trianglesVertices, Vec2 translation, f32 rotation, Vec4 color, Vec3 outlineColor, bool isStatic);
 	void emitter(Vec2 position, bool isPreview, bool isSelected);
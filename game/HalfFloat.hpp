@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Types.hpp>
+#include <bit>
+
+// 16-bit floats used for storage only. The arithmetic is done after converting to f32.
+
+// IEEE half precision. 11 significant bits, the largest finite value is 65504.
+struct F16 {
+	u16 bits;
+};
+
+// The top half of an f32. 8 significant bits and the same range as f32.
+struct BF16 {
+	u16 bits;
+};
+
+inline f32 toF32(f32 value) {
+	return value;
+}
+
+inline f32 toF32(F16 value) {
+	const auto shiftedExponentMask = u32(0x7c00) << 13;
+	auto bits = u32(value.bits & 0x7fff) << 13;
+	const auto exponent = bits & shiftedExponentMask;
+	bits += u32(127 - 15) << 23;
+	if (exponent == shiftedExponentMask) {
+		// Infinity or NaN.
+		bits += u32(128 - 16) << 23;
+	} else if (exponent == 0) {
+		// Zero or subnormal. Renormalized by subtracting the implicit bit.
+		bits += u32(1) << 23;
+		bits = std::bit_cast<u32>(std::bit_cast<f32>(bits) - std::bit_cast<f32>(u32(113) << 23));
+	}
+	return std::bit_cast<f32>(bits | (u32(value.bits & 0x8000) << 16));
+}
+
+inline f32 toF32(BF16 value) {
+	return std::bit_cast<f32>(u32(value.bits) << 16);
+}
+
+template<typename T>
+T fromF32(f32 value);
+
+template<>
+inline f32 fromF32<f32>(f32 value) {
+	return value;
+}
+
+// Rounds to nearest even. Values too big for the format become infinity.
+template<>
+inline F16 fromF32<F16>(f32 value) {
+	auto bits = std::bit_cast<u32>(value);
+	const auto sign = bits & 0x80000000;
+	bits ^= sign;
+
+	u32 result;
+	if (bits >= (u32(127 + 16) << 23)) {
+		result = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+	} else if (bits < (u32(113) << 23)) {
+		// The result is subnormal. Adding the magic number aligns the 10 bits of the significand with the bottom of the f32 and the addition does the rounding.
+		const auto magic = u32((127 - 15) + (23 - 10) + 1) << 23;
+		result = std::bit_cast<u32>(std::bit_cast<f32>(bits) + std::bit_cast<f32>(magic)) - magic;
+	} else {
+		const auto significandOdd = (bits >> 13) & 1;
+		bits += (u32(15 - 127) << 23) + 0xfff + significandOdd;
+		result = bits >> 13;
+	}
+	return F16{ u16(result | (sign >> 16)) };
+}
+
+// Rounds to nearest even. NaNs aren't preserved.
+template<>
+inline BF16 fromF32<BF16>(f32 value) {
+	const auto bits = std::bit_cast<u32>(value);
+	return BF16{ u16((bits + 0x7fff + ((bits >> 16) & 1)) >> 16) };
+}
@@ -111,6 +111,7 @@ void MainLoop::switchFromEditorToSimulation() {
 	simulation.camera = editor.camera;
 	simulation.reset();
 	simulation.simulationSettings = editor.simulationSettings;
+	simulation.levelBounds = editor.levelBounds();
 
 	editorRigidBodyIdToPhysicsId.clear();
 	for (auto body : editor.rigidBodies) {
@@ -228,7 +229,8 @@ void MainLoop::switchFromEditorToSimulation() {
 		case RELFECTING:
 			simulation.reflectingObjects.add(Simulation::ReflectingObject{
 				.id = bodyId,
-				.shape = std::move(shapeInfo)
+				.shape = std::move(shapeInfo),
+				.isStatic = body->isStatic
 			});
 			break;
 
@@ -241,6 +243,14 @@ void MainLoop::switchFromEditorToSimulation() {
 			});
 			break;
 
+		case DAMPING:
+			simulation.dampingObjects.add(Simulation::DampingObject{
+				.id = bodyId,
+				.shape = std::move(shapeInfo),
+				.damping = body->material.damping.damping
+			});
+			break;
+
 		}
 
 	}
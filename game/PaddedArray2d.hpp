@@ -0,0 +1,162 @@
+#pragma once
+
+#include <Types.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+constexpr i64 CACHE_LINE_SIZE = 64;
+
+// Allocates the elements starting on a cache line.
+template<typename T>
+struct CacheLineAllocator {
+	using value_type = T;
+
+	CacheLineAllocator() = default;
+	template<typename U>
+	CacheLineAllocator(const CacheLineAllocator<U>&) {}
+
+	T* allocate(std::size_t count) {
+		return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(CACHE_LINE_SIZE)));
+	}
+
+	void deallocate(T* p, std::size_t) {
+		::operator delete(p, std::align_val_t(CACHE_LINE_SIZE));
+	}
+
+	template<typename U>
+	bool operator==(const CacheLineAllocator<U>&) const {
+		return true;
+	}
+};
+
+using CacheLineBytes = std::vector<u8, CacheLineAllocator<u8>>;
+
+// Rounds count up to a multiple of alignment.
+constexpr i64 roundUpToMultiple(i64 count, i64 alignment) {
+	return (count + alignment - 1) / alignment * alignment;
+}
+
+// A sizeX x sizeY array surrounded by ghostWidth cells on every side. Every row starts on a cache line.
+template<typename T>
+struct PaddedArray2d {
+	static_assert(CACHE_LINE_SIZE % sizeof(T) == 0);
+
+	PaddedArray2d(i64 sizeX, i64 sizeY, i64 ghostWidth, const T& value);
+
+	// Sets every cell to value. Keeps the allocation when it is big enough.
+	void resize(i64 sizeX, i64 sizeY, const T& value);
+
+	T& operator()(i64 x, i64 y);
+	const T& operator()(i64 x, i64 y) const;
+	// Points at the cell (0, y).
+	T* row(i64 y);
+	const T* row(i64 y) const;
+
+	i64 sizeX() const;
+	i64 sizeY() const;
+	i64 ghostWidth() const;
+	i64 pitch() const;
+
+	// Sets the interior and the ghost cells.
+	void fill(const T& value);
+	void fillGhostCells(const T& value);
+	// Sets each ghost cell to the closest interior cell.
+	void clampGhostCells();
+
+private:
+	i64 interiorSizeX;
+	i64 interiorSizeY;
+	i64 ghost;
+	i64 rowPitch;
+	std::vector<T, CacheLineAllocator<T>> cells;
+};
+
+template<typename T>
+PaddedArray2d<T>::PaddedArray2d(i64 sizeX, i64 sizeY, i64 ghostWidth, const T& value)
+	: interiorSizeX(sizeX)
+	, interiorSizeY(sizeY)
+	, ghost(ghostWidth)
+	, rowPitch(roundUpToMultiple(sizeX + 2 * ghostWidth, CACHE_LINE_SIZE / i64(sizeof(T))))
+	, cells((sizeY + 2 * ghostWidth) * rowPitch, value) {}
+
+template<typename T>
+void PaddedArray2d<T>::resize(i64 sizeX, i64 sizeY, const T& value) {
+	interiorSizeX = sizeX;
+	interiorSizeY = sizeY;
+	rowPitch = roundUpToMultiple(sizeX + 2 * ghost, CACHE_LINE_SIZE / i64(sizeof(T)));
+	cells.assign((sizeY + 2 * ghost) * rowPitch, value);
+}
+
+template<typename T>
+T& PaddedArray2d<T>::operator()(i64 x, i64 y) {
+	return row(y)[x];
+}
+
+template<typename T>
+const T& PaddedArray2d<T>::operator()(i64 x, i64 y) const {
+	return row(y)[x];
+}
+
+template<typename T>
+T* PaddedArray2d<T>::row(i64 y) {
+	return cells.data() + (y + ghost) * rowPitch + ghost;
+}
+
+template<typename T>
+const T* PaddedArray2d<T>::row(i64 y) const {
+	return cells.data() + (y + ghost) * rowPitch + ghost;
+}
+
+template<typename T>
+i64 PaddedArray2d<T>::sizeX() const {
+	return interiorSizeX;
+}
+
+template<typename T>
+i64 PaddedArray2d<T>::sizeY() const {
+	return interiorSizeY;
+}
+
+template<typename T>
+i64 PaddedArray2d<T>::ghostWidth() const {
+	return ghost;
+}
+
+template<typename T>
+i64 PaddedArray2d<T>::pitch() const {
+	return rowPitch;
+}
+
+template<typename T>
+void PaddedArray2d<T>::fill(const T& value) {
+	std::fill(cells.begin(), cells.end(), value);
+}
+
+template<typename T>
+void PaddedArray2d<T>::fillGhostCells(const T& value) {
+	for (i64 y = -ghost; y < interiorSizeY + ghost; y++) {
+		if (y < 0 || y >= interiorSizeY) {
+			std::fill_n(row(y) - ghost, interiorSizeX + 2 * ghost, value);
+		} else {
+			std::fill_n(row(y) - ghost, ghost, value);
+			std::fill_n(row(y) + interiorSizeX, ghost, value);
+		}
+	}
+}
+
+template<typename T>
+void PaddedArray2d<T>::clampGhostCells() {
+	if (interiorSizeX <= 0 || interiorSizeY <= 0) {
+		return;
+	}
+	for (i64 y = 0; y < interiorSizeY; y++) {
+		std::fill_n(row(y) - ghost, ghost, row(y)[0]);
+		std::fill_n(row(y) + interiorSizeX, ghost, row(y)[interiorSizeX - 1]);
+	}
+	for (i64 g = 1; g <= ghost; g++) {
+		std::copy_n(row(0) - ghost, interiorSizeX + 2 * ghost, row(-g) - ghost);
+		std::copy_n(row(interiorSizeY - 1) - ghost, interiorSizeX + 2 * ghost, row(interiorSizeY - 1 + g) - ghost);
+	}
+}
@@ -66,11 +66,13 @@ Json::Value toJson(const LevelShapePolygon& value) {
 
 static constexpr auto LevelMaterialTransimissiveName = "transimissive";
 static constexpr auto LevelMaterialReflectiveName = "reflective";
+static constexpr auto LevelMaterialDampingName = "damping";
 
 template<>
 LevelMaterial fromJson<LevelMaterial>(const Json::Value& json) {
 	UNJSON(LevelMaterialTransimissive)
 	UNJSON(LevelMaterialReflective)
+	UNJSON(LevelMaterialDamping)
 	throw Json::Value::Exception{};
 }
 
@@ -78,6 +80,7 @@ Json::Value toJson(const LevelMaterial& value) {
 	return std::visit(overloaded{
 		JSON(LevelMaterialTransimissive)
 		JSON(LevelMaterialReflective)
+		JSON(LevelMaterialDamping)
 	}, value);
 }
 
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <Types.hpp>
+#include <game/HalfFloat.hpp>
+#include <immintrin.h>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+// Thin wrappers over the widest f32 and f64 vectors the translation unit is compiled for so the kernels can be written once. F64xN has half as many lanes as F32xN.
+// Only implements the operations that the kernels use. The loads and stores are unaligned. F16 and BF16 are converted to and from f32 when loading and storing.
+// gather and shuffle set lane i to table[indices[i]]. shuffle takes the first SHUFFLE_TABLE_SIZE entries of the table in a vector and is a lot faster. It is only defined when SHUFFLE_TABLE_SIZE isn't 0.
+// Defining SIMD_SCALAR before including selects the scalar fallback regardless of the compile options.
+
+// The same functions get compiled with different instruction sets in different translation units. Internal linkage stops the linker from merging them, which could make a translation unit call a version using instructions the cpu doesn't support.
+namespace {
+
+#if defined(SIMD_SCALAR)
+
+#elif defined(__AVX512F__)
+
+// The unmasked forms of some of the instructions pass an undefined source to the builtins, which GCC 12 warns about, so the forms with a zero source and all the lanes set are used instead.
+constexpr __mmask16 ALL_LANES_16 = 0xffff;
+constexpr __mmask8 ALL_LANES_8 = 0xff;
+
+struct F32xN {
+	using Scalar = f32;
+	static constexpr i64 LANES = 16;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 16;
+	static constexpr const char* INSTRUCTION_SET_NAME = "AVX-512";
+
+	static F32xN load(const f32* p) { return F32xN{ _mm512_loadu_ps(p) }; }
+	static F32xN load(const F16* p) { return F32xN{ _mm512_maskz_cvtph_ps(ALL_LANES_16, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) }; }
+	static F32xN load(const BF16* p) {
+		const auto bits = _mm512_maskz_cvtepu16_epi32(ALL_LANES_16, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+		return F32xN{ _mm512_castsi512_ps(_mm512_maskz_slli_epi32(ALL_LANES_16, bits, 16)) };
+	}
+	static F32xN gather(const f32* table, const u8* indices) {
+		const auto lanes = _mm512_maskz_cvtepu8_epi32(ALL_LANES_16, _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices)));
+		return F32xN{ _mm512_mask_i32gather_ps(_mm512_setzero_ps(), ALL_LANES_16, lanes, table, sizeof(f32)) };
+	}
+	static F32xN shuffle(F32xN table, const u8* indices) {
+		const auto lanes = _mm512_maskz_cvtepu8_epi32(ALL_LANES_16, _mm_loadu_si128(reinterpret_cast<const __m128i*>(indices)));
+		return F32xN{ _mm512_maskz_permutexvar_ps(ALL_LANES_16, lanes, table.v) };
+	}
+	static F32xN broadcast(f32 value) { return F32xN{ _mm512_set1_ps(value) }; }
+	void store(f32* p) const { _mm512_storeu_ps(p, v); }
+	void store(F16* p) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_maskz_cvtps_ph(ALL_LANES_16, v, _MM_FROUND_TO_NEAREST_INT)); }
+	void store(BF16* p) const {
+		const auto bits = _mm512_castps_si512(v);
+		const auto roundingBias = _mm512_add_epi32(_mm512_set1_epi32(0x7fff), _mm512_and_si512(_mm512_maskz_srli_epi32(ALL_LANES_16, bits, 16), _mm512_set1_epi32(1)));
+		const auto rounded = _mm512_maskz_srli_epi32(ALL_LANES_16, _mm512_add_epi32(bits, roundingBias), 16);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(p), _mm512_maskz_cvtepi32_epi16(ALL_LANES_16, rounded));
+	}
+
+	__m512 v;
+};
+
+inline F32xN operator+(F32xN a, F32xN b) { return F32xN{ _mm512_add_ps(a.v, b.v) }; }
+inline F32xN operator-(F32xN a, F32xN b) { return F32xN{ _mm512_sub_ps(a.v, b.v) }; }
+inline F32xN operator*(F32xN a, F32xN b) { return F32xN{ _mm512_mul_ps(a.v, b.v) }; }
+inline F32xN sqrt(F32xN a) { return F32xN{ _mm512_maskz_sqrt_ps(ALL_LANES_16, a.v) }; }
+// a * b + c
+inline F32xN mulAdd(F32xN a, F32xN b, F32xN c) { return F32xN{ _mm512_fmadd_ps(a.v, b.v, c.v) }; }
+// Bit i is set if lane i is greater than 0.
+inline u32 positiveLanesMask(F32xN a) { return _mm512_cmp_ps_mask(a.v, _mm512_setzero_ps(), _CMP_GT_OQ); }
+
+struct F64xN {
+	using Scalar = f64;
+	static constexpr i64 LANES = 8;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 8;
+
+	static F64xN load(const f64* p) { return F64xN{ _mm512_loadu_pd(p) }; }
+	static F64xN gather(const f64* table, const u8* indices) {
+		return F64xN{ _mm512_mask_i32gather_pd(_mm512_setzero_pd(), ALL_LANES_8, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices))), table, sizeof(f64)) };
+	}
+	static F64xN shuffle(F64xN table, const u8* indices) {
+		const auto lanes = _mm512_maskz_cvtepu8_epi64(ALL_LANES_8, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices)));
+		return F64xN{ _mm512_maskz_permutexvar_pd(ALL_LANES_8, lanes, table.v) };
+	}
+	static F64xN broadcast(f64 value) { return F64xN{ _mm512_set1_pd(value) }; }
+	void store(f64* p) const { _mm512_storeu_pd(p, v); }
+
+	__m512d v;
+};
+
+inline F64xN operator+(F64xN a, F64xN b) { return F64xN{ _mm512_add_pd(a.v, b.v) }; }
+inline F64xN operator-(F64xN a, F64xN b) { return F64xN{ _mm512_sub_pd(a.v, b.v) }; }
+inline F64xN operator*(F64xN a, F64xN b) { return F64xN{ _mm512_mul_pd(a.v, b.v) }; }
+inline F64xN sqrt(F64xN a) { return F64xN{ _mm512_maskz_sqrt_pd(ALL_LANES_8, a.v) }; }
+inline F64xN mulAdd(F64xN a, F64xN b, F64xN c) { return F64xN{ _mm512_fmadd_pd(a.v, b.v, c.v) }; }
+
+#define SIMD_HAS_VECTOR
+
+#elif defined(__AVX2__)
+
+struct F32xN {
+	using Scalar = f32;
+	static constexpr i64 LANES = 8;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 8;
+	static constexpr const char* INSTRUCTION_SET_NAME = "AVX2";
+
+	static F32xN load(const f32* p) { return F32xN{ _mm256_loadu_ps(p) }; }
+	static F32xN load(const F16* p) {
+#if defined(__F16C__) || defined(_MSC_VER)
+		return F32xN{ _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) };
+#else
+		f32 values[LANES];
+		for (i64 i = 0; i < LANES; i++) {
+			values[i] = toF32(p[i]);
+		}
+		return load(values);
+#endif
+	}
+	static F32xN load(const BF16* p) {
+		const auto bits = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+		return F32xN{ _mm256_castsi256_ps(_mm256_slli_epi32(bits, 16)) };
+	}
+	static F32xN gather(const f32* table, const u8* indices) {
+		return F32xN{ _mm256_i32gather_ps(table, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices))), sizeof(f32)) };
+	}
+	static F32xN shuffle(F32xN table, const u8* indices) {
+		return F32xN{ _mm256_permutevar8x32_ps(table.v, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices)))) };
+	}
+	static F32xN broadcast(f32 value) { return F32xN{ _mm256_set1_ps(value) }; }
+	void store(f32* p) const { _mm256_storeu_ps(p, v); }
+	void store(F16* p) const {
+#if defined(__F16C__) || defined(_MSC_VER)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+#else
+		f32 values[LANES];
+		store(values);
+		for (i64 i = 0; i < LANES; i++) {
+			p[i] = fromF32<F16>(values[i]);
+		}
+#endif
+	}
+	void store(BF16* p) const {
+		const auto bits = _mm256_castps_si256(v);
+		const auto roundingBias = _mm256_add_epi32(_mm256_set1_epi32(0x7fff), _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1)));
+		// The arithmetic shift sign extends the results, so the saturating pack keeps all of their bits.
+		const auto rounded = _mm256_srai_epi32(_mm256_add_epi32(bits, roundingBias), 16);
+		// The pack works within 128-bit lanes.
+		const auto packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(rounded, rounded), 0b1000);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm256_castsi256_si128(packed));
+	}
+
+	__m256 v;
+};
+
+inline F32xN operator+(F32xN a, F32xN b) { return F32xN{ _mm256_add_ps(a.v, b.v) }; }
+inline F32xN operator-(F32xN a, F32xN b) { return F32xN{ _mm256_sub_ps(a.v, b.v) }; }
+inline F32xN operator*(F32xN a, F32xN b) { return F32xN{ _mm256_mul_ps(a.v, b.v) }; }
+inline F32xN sqrt(F32xN a) { return F32xN{ _mm256_sqrt_ps(a.v) }; }
+
+// a * b + c
+inline F32xN mulAdd(F32xN a, F32xN b, F32xN c) {
+#if defined(__FMA__) || defined(_MSC_VER)
+	return F32xN{ _mm256_fmadd_ps(a.v, b.v, c.v) };
+#else
+	return a * b + c;
+#endif
+}
+
+inline u32 positiveLanesMask(F32xN a) { return _mm256_movemask_ps(_mm256_cmp_ps(a.v, _mm256_setzero_ps(), _CMP_GT_OQ)); }
+
+struct F64xN {
+	using Scalar = f64;
+	static constexpr i64 LANES = 4;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 4;
+
+	static F64xN load(const f64* p) { return F64xN{ _mm256_loadu_pd(p) }; }
+	static F64xN gather(const f64* table, const u8* indices) {
+		// The unmasked form passes an undefined source, which GCC 12 warns about.
+		const auto allLanes = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+		return F64xN{ _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, _mm_cvtepu8_epi32(loadIndices(indices)), allLanes, sizeof(f64)) };
+	}
+	// There is no variable shuffle of 64-bit lanes, so each index selects a pair of 32-bit lanes.
+	static F64xN shuffle(F64xN table, const u8* indices) {
+		const auto first = _mm256_slli_epi64(_mm256_cvtepu8_epi64(loadIndices(indices)), 1);
+		const auto pairs = _mm256_or_si256(first, _mm256_slli_epi64(_mm256_add_epi64(first, _mm256_set1_epi64x(1)), 32));
+		return F64xN{ _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(table.v), pairs)) };
+	}
+	static __m128i loadIndices(const u8* indices) {
+		i32 packed;
+		std::memcpy(&packed, indices, sizeof(packed));
+		return _mm_cvtsi32_si128(packed);
+	}
+	static F64xN broadcast(f64 value) { return F64xN{ _mm256_set1_pd(value) }; }
+	void store(f64* p) const { _mm256_storeu_pd(p, v); }
+
+	__m256d v;
+};
+
+inline F64xN operator+(F64xN a, F64xN b) { return F64xN{ _mm256_add_pd(a.v, b.v) }; }
+inline F64xN operator-(F64xN a, F64xN b) { return F64xN{ _mm256_sub_pd(a.v, b.v) }; }
+inline F64xN operator*(F64xN a, F64xN b) { return F64xN{ _mm256_mul_pd(a.v, b.v) }; }
+inline F64xN sqrt(F64xN a) { return F64xN{ _mm256_sqrt_pd(a.v) }; }
+
+inline F64xN mulAdd(F64xN a, F64xN b, F64xN c) {
+#if defined(__FMA__) || defined(_MSC_VER)
+	return F64xN{ _mm256_fmadd_pd(a.v, b.v, c.v) };
+#else
+	return a * b + c;
+#endif
+}
+
+#define SIMD_HAS_VECTOR
+
+#elif defined(__SSE4_1__) || defined(_M_X64) || defined(__x86_64__)
+
+struct F32xN {
+	using Scalar = f32;
+	static constexpr i64 LANES = 4;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 0;
+	static constexpr const char* INSTRUCTION_SET_NAME = "SSE4.2";
+
+	static F32xN load(const f32* p) { return F32xN{ _mm_loadu_ps(p) }; }
+	// F16C isn't part of SSE4.2.
+	static F32xN load(const F16* p) { return F32xN{ _mm_setr_ps(toF32(p[0]), toF32(p[1]), toF32(p[2]), toF32(p[3])) }; }
+	static F32xN load(const BF16* p) {
+		const auto bits = _mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+		return F32xN{ _mm_castsi128_ps(bits) };
+	}
+	// SSE has no gather instruction.
+	static F32xN gather(const f32* table, const u8* indices) { return F32xN{ _mm_setr_ps(table[indices[0]], table[indices[1]], table[indices[2]], table[indices[3]]) }; }
+	static F32xN broadcast(f32 value) { return F32xN{ _mm_set1_ps(value) }; }
+	void store(f32* p) const { _mm_storeu_ps(p, v); }
+	void store(F16* p) const {
+		f32 values[LANES];
+		store(values);
+		for (i64 i = 0; i < LANES; i++) {
+			p[i] = fromF32<F16>(values[i]);
+		}
+	}
+	void store(BF16* p) const {
+		const auto bits = _mm_castps_si128(v);
+		const auto roundingBias = _mm_add_epi32(_mm_set1_epi32(0x7fff), _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1)));
+		// The arithmetic shift sign extends the results, so the saturating pack keeps all of their bits.
+		const auto rounded = _mm_srai_epi32(_mm_add_epi32(bits, roundingBias), 16);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packs_epi32(rounded, rounded));
+	}
+
+	__m128 v;
+};
+
+inline F32xN operator+(F32xN a, F32xN b) { return F32xN{ _mm_add_ps(a.v, b.v) }; }
+inline F32xN operator-(F32xN a, F32xN b) { return F32xN{ _mm_sub_ps(a.v, b.v) }; }
+inline F32xN operator*(F32xN a, F32xN b) { return F32xN{ _mm_mul_ps(a.v, b.v) }; }
+inline F32xN sqrt(F32xN a) { return F32xN{ _mm_sqrt_ps(a.v) }; }
+inline F32xN mulAdd(F32xN a, F32xN b, F32xN c) { return a * b + c; }
+inline u32 positiveLanesMask(F32xN a) { return _mm_movemask_ps(_mm_cmpgt_ps(a.v, _mm_setzero_ps())); }
+
+struct F64xN {
+	using Scalar = f64;
+	static constexpr i64 LANES = 2;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 0;
+
+	static F64xN load(const f64* p) { return F64xN{ _mm_loadu_pd(p) }; }
+	static F64xN gather(const f64* table, const u8* indices) { return F64xN{ _mm_setr_pd(table[indices[0]], table[indices[1]]) }; }
+	static F64xN broadcast(f64 value) { return F64xN{ _mm_set1_pd(value) }; }
+	void store(f64* p) const { _mm_storeu_pd(p, v); }
+
+	__m128d v;
+};
+
+inline F64xN operator+(F64xN a, F64xN b) { return F64xN{ _mm_add_pd(a.v, b.v) }; }
+inline F64xN operator-(F64xN a, F64xN b) { return F64xN{ _mm_sub_pd(a.v, b.v) }; }
+inline F64xN operator*(F64xN a, F64xN b) { return F64xN{ _mm_mul_pd(a.v, b.v) }; }
+inline F64xN sqrt(F64xN a) { return F64xN{ _mm_sqrt_pd(a.v) }; }
+inline F64xN mulAdd(F64xN a, F64xN b, F64xN c) { return a * b + c; }
+
+#define SIMD_HAS_VECTOR
+
+#endif
+
+#if !defined(SIMD_HAS_VECTOR)
+
+struct F32xN {
+	using Scalar = f32;
+	static constexpr i64 LANES = 1;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 0;
+	static constexpr const char* INSTRUCTION_SET_NAME = "scalar";
+
+	static F32xN load(const f32* p) { return F32xN{ *p }; }
+	static F32xN load(const F16* p) { return F32xN{ toF32(*p) }; }
+	static F32xN load(const BF16* p) { return F32xN{ toF32(*p) }; }
+	static F32xN gather(const f32* table, const u8* indices) { return F32xN{ table[*indices] }; }
+	static F32xN broadcast(f32 value) { return F32xN{ value }; }
+	void store(f32* p) const { *p = v; }
+	void store(F16* p) const { *p = fromF32<F16>(v); }
+	void store(BF16* p) const { *p = fromF32<BF16>(v); }
+
+	f32 v;
+};
+
+inline F32xN operator+(F32xN a, F32xN b) { return F32xN{ a.v + b.v }; }
+inline F32xN operator-(F32xN a, F32xN b) { return F32xN{ a.v - b.v }; }
+inline F32xN operator*(F32xN a, F32xN b) { return F32xN{ a.v * b.v }; }
+inline F32xN sqrt(F32xN a) { return F32xN{ std::sqrt(a.v) }; }
+inline F32xN mulAdd(F32xN a, F32xN b, F32xN c) { return a * b + c; }
+inline u32 positiveLanesMask(F32xN a) { return a.v > 0.0f ? 1 : 0; }
+
+struct F64xN {
+	using Scalar = f64;
+	static constexpr i64 LANES = 1;
+	static constexpr i64 SHUFFLE_TABLE_SIZE = 0;
+
+	static F64xN load(const f64* p) { return F64xN{ *p }; }
+	static F64xN gather(const f64* table, const u8* indices) { return F64xN{ table[*indices] }; }
+	static F64xN broadcast(f64 value) { return F64xN{ value }; }
+	void store(f64* p) const { *p = v; }
+
+	f64 v;
+};
+
+inline F64xN operator+(F64xN a, F64xN b) { return F64xN{ a.v + b.v }; }
+inline F64xN operator-(F64xN a, F64xN b) { return F64xN{ a.v - b.v }; }
+inline F64xN operator*(F64xN a, F64xN b) { return F64xN{ a.v * b.v }; }
+inline F64xN sqrt(F64xN a) { return F64xN{ std::sqrt(a.v) }; }
+inline F64xN mulAdd(F64xN a, F64xN b, F64xN c) { return a * b + c; }
+
+#endif
+
+#undef SIMD_HAS_VECTOR
+
+template<typename Scalar>
+using SimdVector = std::conditional_t<std::is_same_v<Scalar, f64>, F64xN, F32xN>;
+
+}
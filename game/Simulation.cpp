@@ -21,6 +21,11 @@
 #include <gfx/Instancing.hpp>
 #include <glad/glad.h>
 #include <game/Constants.hpp>
+#include <game/WaveSolver.hpp>
+#include <game/WaveKernels.hpp>
+#include <game/WaveSolverTuning.hpp>
+#include <array>
+#include <bit>
 
 i32 clamp(i32 i, i32 max) {
 	if (i < 0) {
@@ -41,39 +46,45 @@ Aabb transformedTriangleAabb(Vec2 v0, Vec2 v1, Vec2 v2, Vec2 position, Rotation
 	return Aabb::fromPoints(constView(points));
 }
 
-template<typename T>
-void fillTriangle(View2d<T> a, Vec2 v0, Vec2 v1, Vec2 v2, Rotation rotation, Vec2 translation, T value, Aabb gridBounds, Vec2T<i64> gridSize) {
+GridAabb intersectGridAabbs(const GridAabb& a, const GridAabb& b) {
+	return GridAabb(
+		Vec2T<i64>(std::max(a.min.x, b.min.x), std::max(a.min.y, b.min.y)),
+		Vec2T<i64>(std::min(a.max.x, b.max.x), std::min(a.max.y, b.max.y)));
+}
+
+// Calls fillRow(yi, xBegin, covered, count) for each row of cells of the triangle's aabb inside cells, where covered[i] is nonzero if the triangle covers the cell xBegin + i.
+template<typename FillRow>
+void rasterizeTriangle(Vec2 v0, Vec2 v1, Vec2 v2, Rotation rotation, Vec2 translation, Aabb gridBounds, Vec2T<i64> gridSize, const GridAabb& cells, f32 cellSize, std::vector<u8>& covered, FillRow fillRow) {
 	const auto aabb = transformedTriangleAabb(v0, v1, v2, translation, rotation);
-	const auto gridAabb = aabbToClampedGridAabb(aabb, gridBounds, gridSize);
+	const auto gridAabb = intersectGridAabbs(aabbToClampedGridAabb(aabb, gridBounds, gridSize), cells);
 
 	const auto a0 = v1 - v0;
 	const auto a1 = v2 - v1;
 	const auto a2 = v0 - v2;
 
 	const auto rotationInversed = rotation.inversed();
+	auto area = [](Vec2 edge, Vec2 b) {
+		return edge.x * b.y - b.x * edge.y;
+	};
+	// The areas are linear in the cell's x, so each row only needs the areas of the first cell and how they change when moving by one cell.
+	auto xStep = Vec2(cellSize, 0.0f);
+	xStep *= rotationInversed;
+	const auto area0Step = area(a0, xStep);
+	const auto area1Step = area(a1, xStep);
+	const auto area2Step = area(a2, xStep);
+
+	const auto rowLength = gridAabb.max.x - gridAabb.min.x + 1;
+	if (rowLength <= 0) {
+		return;
+	}
+	covered.resize(rowLength);
 	for (i64 yi = gridAabb.min.y; yi <= gridAabb.max.y; yi++) {
-		for (i64 xi = gridAabb.min.x; xi <= gridAabb.max.x; xi++) {
-			auto cellCenter = Vec2(xi - 0.5f, yi - 0.5f) * Constants::CELL_SIZE + gridBounds.min;
-			cellCenter -= translation;
-			cellCenter *= rotationInversed;
-
-			const auto b0 = cellCenter - v0;
-			auto area0 = a0.x * b0.y - b0.x * a0.y;
-			if (area0 <= 0.0f) {
-				continue;
-			}
-			const auto b1 = cellCenter - v1;
-			auto area1 = a1.x * b1.y - b1.x * a1.y;
-			if (area1 <= 0.0f) { 
-				continue;
-			}
-			const auto b2 = cellCenter - v2;
-			auto area2 = a2.x * b2.y - b2.x * a2.y;
-			if (area2 <= 0.0f) {
-				continue;
-			}
-			a(xi, yi) = value;
-		}
+		auto cellCenter = Vec2(gridAabb.min.x - 0.5f, yi - 0.5f) * cellSize + gridBounds.min;
+		cellCenter -= translation;
+		cellCenter *= rotationInversed;
+
+		rasterizeTriangleCoverageRow(covered.data(), area(a0, cellCenter - v0), area(a1, cellCenter - v1), area(a2, cellCenter - v2), area0Step, area1Step, area2Step, rowLength);
+		fillRow(yi, gridAabb.min.x, covered.data(), rowLength);
 	}
 }
 
@@ -118,26 +129,32 @@ Aabb simulationPolygonAabb(View<const Vec2> verts, Vec2 translation, f32 rotatio
 
 Simulation::Simulation(Gfx2d& gfx)
 	: simulationGridSize(Constants::DEFAULT_GRID_SIZE.x + 2, Constants::DEFAULT_GRID_SIZE.y + 2)
+	, cellSize(Constants::DEFAULT_CELL_SIZE)
+	, gridOrigin(0.0f)
 	, simulationSettings(SimulationSettings::makeDefault())
-	, u(Array2d<f32>::filled(simulationGridSize.x, simulationGridSize.y, 0.0f))
-	, u_t(Array2d<f32>::filled(simulationGridSize.x, simulationGridSize.y, 0.0f))
-	, speedSquared(Array2d<f32>::filled(simulationGridSize.x, simulationGridSize.y, 0.0f))
-	, cellType(Array2d<CellType>::filled(simulationGridSize.x, simulationGridSize.y, CellType::EMPTY))
-	, debugDisplayGrid(Array2d<Pixel32>::filled(simulationGridSize.x - 2, simulationGridSize.y - 2, Pixel32(0, 0, 0))) 
+	, waveSolverSettings(WaveSolverSettings::makeDefault())
+	, waveField(simulationGridSize.x, simulationGridSize.y, WaveStorageFormat::F32)
+	, waveMaterial(Constants::DEFAULT_GRID_SIZE.x, Constants::DEFAULT_GRID_SIZE.y, 1, 0)
+	, debugDisplayGrid(simulationGridSize.x - 2, simulationGridSize.y - 2, 0, Pixel32(0, 0, 0))
 	, debugDisplayTexture(makePixelTexture(debugDisplayGrid.sizeX(), debugDisplayGrid.sizeY()))
-	, displayGrid(Array2d<f32>::filled(simulationGridSize.x - 2, simulationGridSize.y - 2, 0.0f))
-	, displayGridTemp(Array2d<f32>::filled(simulationGridSize.x - 2, simulationGridSize.y - 2, 0.0f))
+	, displayGrid(simulationGridSize.x - 2, simulationGridSize.y - 2, 0, 0.0f)
+	, displayGridTemp(simulationGridSize.x - 2, simulationGridSize.y - 2, 1, 0.0f)
 	, displayTexture(makeFloatTexture(debugDisplayGrid.sizeX(), debugDisplayGrid.sizeY()))
 	, reflectingObjects(List<ReflectingObject>::empty())
 	, transmissiveObjects(List<TransmissiveObject>::empty())
+	, dampingObjects(List<DampingObject>::empty())
 	, emitters(List<Emitter>::empty())
 	, revoluteJoints(List<RevoluteJoint>::empty())
 	, mouseJoint(b2_nullJointId)
 	, getShapesResult(List<b2ShapeId>::empty())
 	, realtimeDt(1.0f / 60.0f)
-	, simulationElapsed(0.0f)
+	, simulationElapsed(0.0)
 	, display3d(SimulationDisplay3d::make(gfx.instancesVbo)) {
 
+	wallSpans.clear(simulationGridSize.y);
+
+	tuneWaveSolverForGrid();
+
 	{
 		b2WorldDef worldDef = b2DefaultWorldDef();
 		worldDef.gravity = b2Vec2{ 0.0f, -10.0f };
@@ -151,28 +168,7 @@ Simulation::Simulation(Gfx2d& gfx)
 		backgroundBodyId = b2CreateBody(world, &bodyDef);
 	}
 
-	{
-		const auto halfWidth = 10.0f;
-		const auto bounds = displayGridBounds();
-		const auto boundsSize = bounds.size();
-		const auto boundsCenter = bounds.center();
-		b2BodyDef bodyDef = b2DefaultBodyDef();
-		bodyDef.position = fromVec2(boundsCenter);
-		boundariesBodyId = b2CreateBody(world, &bodyDef);
-		b2ShapeDef shapeDef = b2DefaultShapeDef();
-
-		b2Polygon bottom = b2MakeOffsetBox(boundsSize.x / 2.0f, halfWidth, b2Vec2{.x = 0.0f, .y = -(boundsSize.y / 2.0f + halfWidth) }, 0.0f);
-		b2CreatePolygonShape(boundariesBodyId, &shapeDef, &bottom);
-
-		b2Polygon top = b2MakeOffsetBox(boundsSize.x / 2.0f, halfWidth, b2Vec2{ .x = 0.0f, .y = (boundsSize.y / 2.0f + halfWidth) }, 0.0f);
-		b2CreatePolygonShape(boundariesBodyId, &shapeDef, &top);
-
-		b2Polygon left = b2MakeOffsetBox(halfWidth, boundsSize.y / 2.0f, b2Vec2{ .x = -(boundsSize.x / 2.0f + halfWidth), .y = 0.0f }, 0.0f);
-		b2CreatePolygonShape(boundariesBodyId, &shapeDef, &left);
-
-		b2Polygon right = b2MakeOffsetBox(halfWidth, boundsSize.y / 2.0f, b2Vec2{ .x = (boundsSize.x / 2.0f + halfWidth), .y = 0.0f }, 0.0f);
-		b2CreatePolygonShape(boundariesBodyId, &shapeDef, &right);
-	}
+	createBoundaries();
 
 	const auto grid3dSize = grid3dScale();
 	display3d.camera.angleAroundUpAxis = 0.0f;
@@ -181,6 +177,128 @@ Simulation::Simulation(Gfx2d& gfx)
 	display3d.camera.position = gridCenter - display3d.camera.forward() * 4.0f;
 }
 
+// Walls around the room keep the bodies in it. A fitted grid doesn't move them.
+void Simulation::createBoundaries() {
+	const auto halfWidth = 10.0f;
+	const auto bounds = roomBounds();
+	const auto boundsSize = bounds.size();
+	const auto boundsCenter = bounds.center();
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.position = fromVec2(boundsCenter);
+	boundariesBodyId = b2CreateBody(world, &bodyDef);
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+
+	b2Polygon bottom = b2MakeOffsetBox(boundsSize.x / 2.0f, halfWidth, b2Vec2{.x = 0.0f, .y = -(boundsSize.y / 2.0f + halfWidth) }, 0.0f);
+	b2CreatePolygonShape(boundariesBodyId, &shapeDef, &bottom);
+
+	b2Polygon top = b2MakeOffsetBox(boundsSize.x / 2.0f, halfWidth, b2Vec2{ .x = 0.0f, .y = (boundsSize.y / 2.0f + halfWidth) }, 0.0f);
+	b2CreatePolygonShape(boundariesBodyId, &shapeDef, &top);
+
+	b2Polygon left = b2MakeOffsetBox(halfWidth, boundsSize.y / 2.0f, b2Vec2{ .x = -(boundsSize.x / 2.0f + halfWidth), .y = 0.0f }, 0.0f);
+	b2CreatePolygonShape(boundariesBodyId, &shapeDef, &left);
+
+	b2Polygon right = b2MakeOffsetBox(halfWidth, boundsSize.y / 2.0f, b2Vec2{ .x = (boundsSize.x / 2.0f + halfWidth), .y = 0.0f }, 0.0f);
+	b2CreatePolygonShape(boundariesBodyId, &shapeDef, &right);
+}
+
+void Simulation::tuneWaveSolverForGrid() {
+	const auto tuning = loadOrTuneWaveSolver(simulationGridSize.x, simulationGridSize.y, waveSolverSettings);
+	waveSolverSettings.threadCount = tuning.threadCount;
+	waveSolverSettings.tileSize = tuning.tileSize;
+}
+
+void Simulation::resizeGrid(Vec2 origin, Vec2T<i64> gridSize, f32 newCellSize) {
+	gridOrigin = origin;
+	cellSize = newCellSize;
+	simulationGridSize = Vec2T<i64>(gridSize.x + 2, gridSize.y + 2);
+	// The arrays keep their memory, so switching between levels doesn't allocate unless the grid gets bigger than any before it.
+	waveField.resize(simulationGridSize.x, simulationGridSize.y);
+	wallSpans.clear(simulationGridSize.y);
+	staticWallSpansOutdated = true;
+	waveMaterial.resize(gridSize.x, gridSize.y, 0);
+	debugDisplayGrid.resize(gridSize.x, gridSize.y, Pixel32(0, 0, 0));
+	displayGrid.resize(gridSize.x, gridSize.y, 0.0f);
+	displayGridTemp.resize(gridSize.x, gridSize.y, 0.0f);
+	debugDisplayTexture.bind();
+	resizePixelTexture(gridSize.x, gridSize.y);
+	displayTexture.bind();
+	resizeFloatTexture(gridSize.x, gridSize.y);
+	tuneWaveSolverForGrid();
+
+	if (B2_IS_NON_NULL(boundariesBodyId)) {
+		b2DestroyBody(boundariesBodyId);
+		boundariesBodyId = b2_nullBodyId;
+	}
+	// The bodies can leave a window following the camera.
+	if (!simulationFollowsCamera(simulationSettings)) {
+		createBoundaries();
+	}
+}
+
+void Simulation::scrollGrid(Vec2 origin) {
+	const auto tileSize = f32(WAVE_FIELD_TILE_SIZE) * cellSize;
+	const auto tileShiftX = i64(std::round((origin.x - gridOrigin.x) / tileSize));
+	const auto tileShiftY = i64(std::round((origin.y - gridOrigin.y) / tileSize));
+	gridOrigin = origin;
+	waveField.scroll(tileShiftX, tileShiftY);
+	waveSolver.fieldMoved();
+
+	// The static walls that stay in the grid are moved and only the cells that entered it are rasterized. The rest of the geometry is rasterized every frame.
+	const auto shiftX = tileShiftX * WAVE_FIELD_TILE_SIZE;
+	const auto shiftY = tileShiftY * WAVE_FIELD_TILE_SIZE;
+	const auto size = simulationGridSize;
+	if (staticWallSpansOutdated || std::abs(shiftX) >= size.x || std::abs(shiftY) >= size.y) {
+		staticWallSpansOutdated = true;
+		return;
+	}
+	WaveWallSpans moved;
+	moved.clear(size.y);
+	for (i64 y = std::max(-shiftY, i64(0)); y < std::min(size.y - shiftY, size.y); y++) {
+		for (i64 i = staticWallSpans.rowOffsets[y + shiftY]; i < staticWallSpans.rowOffsets[y + shiftY + 1]; i++) {
+			moved.add(y, std::max(staticWallSpans.spans[i].begin - shiftX, i64(0)), std::min(staticWallSpans.spans[i].end - shiftX, size.x));
+		}
+	}
+	if (shiftX != 0) {
+		const auto begin = shiftX > 0 ? size.x - shiftX : 0;
+		addStaticWallSpans(moved, GridAabb(Vec2T<i64>(begin, 0), Vec2T<i64>(begin + std::abs(shiftX) - 1, size.y - 1)));
+	}
+	if (shiftY != 0) {
+		const auto begin = shiftY > 0 ? size.y - shiftY : 0;
+		addStaticWallSpans(moved, GridAabb(Vec2T<i64>(0, begin), Vec2T<i64>(size.x - 1, begin + std::abs(shiftY) - 1)));
+	}
+	moved.merge();
+	staticWallSpans = std::move(moved);
+}
+
+SimulationGridDomain Simulation::gridDomain() const {
+	const auto& s = simulationSettings;
+	const auto sceneSize = Vec2T<i64>(s.gridSize.x, s.gridSize.y);
+	if (simulationFollowsCamera(s)) {
+		// Moving in steps of whole tiles of the wave field lets scrollGrid keep the waves without copying them.
+		const auto tileSize = f32(WAVE_FIELD_TILE_SIZE) * s.cellSize;
+		const auto corner = camera.pos - Vec2(f32(sceneSize.x), f32(sceneSize.y)) * s.cellSize / 2.0f;
+		return SimulationGridDomain{ .origin = Vec2(std::round(corner.x / tileSize), std::round(corner.y / tileSize)) * tileSize, .size = sceneSize };
+	}
+	return fittedSimulationGridDomain(s, levelBounds);
+}
+
+SimulationBoundaryConditions Simulation::boundaryConditions() const {
+	const auto& s = simulationSettings;
+	const auto followsCamera = simulationFollowsCamera(s);
+	const auto room = roomBounds();
+	const auto grid = displayGridBounds();
+	const auto tolerance = cellSize / 2.0f;
+	auto condition = [&](SimulationBoundaryCondition setting, bool edgeInsideRoom) {
+		return followsCamera || edgeInsideRoom ? SimulationBoundaryCondition::ABSORBING : setting;
+	};
+	return SimulationBoundaryConditions{
+		.top = condition(s.topBoundaryCondition, grid.max.y < room.max.y - tolerance),
+		.bottom = condition(s.bottomBoundaryCondition, grid.min.y > room.min.y + tolerance),
+		.left = condition(s.leftBoundaryCondition, grid.min.x > room.min.x + tolerance),
+		.right = condition(s.rightBoundaryCondition, grid.max.x < room.max.x - tolerance),
+	};
+}
+
 std::optional<f32> rayPlaneIntersection(Vec3 planeNormal, Vec3 pointOnPlane, Vec3 rayStart, Vec3 rayDirection) {
 	f32 denom = dot(planeNormal, rayDirection);
 	if (abs(denom) > 1e-6) {
@@ -191,26 +309,75 @@ std::optional<f32> rayPlaneIntersection(Vec3 planeNormal, Vec3 pointOnPlane, Vec
 	return std::nullopt;
 }
 
-template<typename T>
-void fillShape(View2d<T> a, T value, Vec2 translation, f32 rotation, const Simulation::ShapeInfo& shape, Aabb gridBounds, Vec2T<i64> gridSize) {
+// Calls fillRow like rasterizeTriangle for the cells covered by the shape.
+template<typename FillRow>
+void rasterizeShape(Vec2 translation, f32 rotation, const Simulation::ShapeInfo& shape, Aabb gridBounds, Vec2T<i64> gridSize, const GridAabb& cells, f32 cellSize, FillRow fillRow) {
+	std::vector<u8> covered;
 	if (shape.type == Simulation::ShapeType::POLYGON) {
 		for (i32 i = 0; i < shape.simplifiedTriangleVertices.size(); i += 3) {
 			const auto v0 = shape.simplifiedTriangleVertices[i];
 			const auto v1 = shape.simplifiedTriangleVertices[i + 1];
 			const auto v2 = shape.simplifiedTriangleVertices[i + 2];
-			fillTriangle(a, v0, v1, v2, rotation, translation, value, gridBounds, gridSize);
+			rasterizeTriangle(v0, v1, v2, rotation, translation, gridBounds, gridSize, cells, cellSize, covered, fillRow);
 		}
 	} else if (shape.type == Simulation::ShapeType::CIRCLE) {
 		const auto shapeAabb = circleAabb(translation, shape.radius);
-		const auto shapeGridAabb = aabbToClampedGridAabb(shapeAabb, gridBounds, gridSize);
+		const auto shapeGridAabb = intersectGridAabbs(aabbToClampedGridAabb(shapeAabb, gridBounds, gridSize), cells);
+		const auto rowLength = shapeGridAabb.max.x - shapeGridAabb.min.x + 1;
+		if (rowLength <= 0) {
+			return;
+		}
+		covered.resize(rowLength);
 		for (i64 yi = shapeGridAabb.min.y; yi <= shapeGridAabb.max.y; yi++) {
-			for (i64 xi = shapeGridAabb.min.x; xi <= shapeGridAabb.max.x; xi++) {
-				const auto cellCenter = Vec2(xi - 0.5f, yi - 0.5f) * Constants::CELL_SIZE + gridBounds.min;
-				if (isPointInCircle(translation, shape.radius, cellCenter)) {
-					a(xi, yi) = value;
-				}
+			for (i64 i = 0; i < rowLength; i++) {
+				const auto cellCenter = Vec2(shapeGridAabb.min.x + i - 0.5f, yi - 0.5f) * cellSize + gridBounds.min;
+				covered[i] = isPointInCircle(translation, shape.radius, cellCenter);
+			}
+			fillRow(yi, shapeGridAabb.min.x, covered.data(), rowLength);
+		}
+	}
+}
+
+// The grid positions start at the first ghost cell of a.
+template<typename T>
+void fillShape(PaddedArray2d<T>& a, T value, Vec2 translation, f32 rotation, const Simulation::ShapeInfo& shape, Aabb gridBounds, Vec2T<i64> gridSize, f32 cellSize) {
+	const GridAabb allCells(Vec2T<i64>(0, 0), Vec2T<i64>(gridSize.x - 1, gridSize.y - 1));
+	rasterizeShape(translation, rotation, shape, gridBounds, gridSize, allCells, cellSize, [&](i64 yi, i64 xBegin, const u8* covered, i64 count) {
+		const auto row = a.row(yi - a.ghostWidth()) + xBegin - a.ghostWidth();
+		for (i64 i = 0; i < count; i++) {
+			if (covered[i]) {
+				row[i] = value;
+			}
+		}
+	});
+}
+
+// Adds the runs of covered cells inside cells of each row. The grid positions are the positions in the wave field.
+void addShapeWallSpans(WaveWallSpans& walls, Vec2 translation, f32 rotation, const Simulation::ShapeInfo& shape, Aabb gridBounds, Vec2T<i64> gridSize, const GridAabb& cells, f32 cellSize) {
+	rasterizeShape(translation, rotation, shape, gridBounds, gridSize, cells, cellSize, [&](i64 yi, i64 xBegin, const u8* covered, i64 count) {
+		for (i64 i = 0; i < count;) {
+			if (!covered[i]) {
+				i++;
+				continue;
 			}
+			const auto begin = i;
+			while (i < count && covered[i]) {
+				i++;
+			}
+			walls.add(yi, xBegin + begin, xBegin + i);
+		}
+	});
+}
+
+void Simulation::addStaticWallSpans(WaveWallSpans& walls, const GridAabb& cells) {
+	const auto simulationGridBounds = this->simulationGridBounds();
+	for (const auto& object : reflectingObjects) {
+		if (!object.isStatic) {
+			continue;
 		}
+		const auto rotation = b2Body_GetAngle(object.id);
+		const auto translation = toVec2(b2Body_GetPosition(object.id));
+		addShapeWallSpans(walls, translation, rotation, object.shape, simulationGridBounds, simulationGridSize, cells, cellSize);
 	}
 }
 
@@ -220,6 +387,21 @@ Simulation::Result Simulation::update(GameRenderer& renderer, const GameInput& i
 		switchToEditor = gui();
 	}
 
+	{
+		const auto domain = gridDomain();
+		const auto sizeChanged = domain.size.x != waveMaterial.sizeX() || domain.size.y != waveMaterial.sizeY();
+		const auto originChanged = domain.origin.x != gridOrigin.x || domain.origin.y != gridOrigin.y;
+		const auto followsCamera = simulationFollowsCamera(simulationSettings);
+		const auto boundariesChanged = B2_IS_NON_NULL(boundariesBodyId) == followsCamera;
+		if (sizeChanged || boundariesChanged || simulationSettings.cellSize != cellSize) {
+			resizeGrid(domain.origin, domain.size, simulationSettings.cellSize);
+		} else if (originChanged && followsCamera) {
+			scrollGrid(domain.origin);
+		} else if (originChanged) {
+			resizeGrid(domain.origin, domain.size, simulationSettings.cellSize);
+		}
+	}
+
 	const auto simulationDt = realtimeDt * simulationSettings.timeScale;
 	simulationElapsed += simulationDt;
 
@@ -253,8 +435,8 @@ Simulation::Result Simulation::update(GameRenderer& renderer, const GameInput& i
 		const auto intersectionT = rayPlaneIntersection(Vec3(0.0f, 1.0f, 0.0f), Vec3(0.0f, 0.0f, 0.0f), rayStart, rayDirection);
 		if (intersectionT.has_value() && (*intersectionT) > 0.0f) {
 			const Vec3 pos = rayStart + (*intersectionT) * rayDirection;
-			const auto displaySize = displayGridBounds().size();
-			cursorPos = Vec2(pos.x, pos.z) / Vec2(grid3dScale.x, grid3dScale.z) * displaySize;
+			const auto displayBounds = displayGridBounds();
+			cursorPos = Vec2(pos.x, pos.z) / Vec2(grid3dScale.x, grid3dScale.z) * displayBounds.size() + displayBounds.min;
 		}
 	}
 
@@ -325,40 +507,132 @@ Simulation::Result Simulation::update(GameRenderer& renderer, const GameInput& i
 
 		const auto simulationGridBounds = this->simulationGridBounds();
 		auto calculateCellCenter = [&](i64 x, i64 y) -> Vec2 {
-			return Vec2(x - 0.5f, y - 0.5f) * Constants::CELL_SIZE + simulationGridBounds.min;
+			return Vec2(x - 0.5f, y - 0.5f) * cellSize + simulationGridBounds.min;
 		};
-		auto transform = [](Vec2 v, Vec2 translation, Rotation rotation) {
-			return ((rotation * v) + translation) / Constants::CELL_SIZE;
+		auto transform = [&](Vec2 v, Vec2 translation, Rotation rotation) {
+			return ((rotation * v) + translation) / cellSize;
 		};
 
 		{
-			fill(cellType, CellType::EMPTY);
-			auto cellTypeView = view2d(cellType);
+			const GridAabb allCells(Vec2T<i64>(0, 0), Vec2T<i64>(simulationGridSize.x - 1, simulationGridSize.y - 1));
+			if (staticWallSpansOutdated) {
+				staticWallSpans.clear(simulationGridSize.y);
+				addStaticWallSpans(staticWallSpans, allCells);
+				staticWallSpans.merge();
+				staticWallSpansOutdated = false;
+			}
+			wallSpans.clear(simulationGridSize.y);
+			for (i64 y = 0; y < simulationGridSize.y; y++) {
+				for (i64 i = staticWallSpans.rowOffsets[y]; i < staticWallSpans.rowOffsets[y + 1]; i++) {
+					wallSpans.add(y, staticWallSpans.spans[i].begin, staticWallSpans.spans[i].end);
+				}
+			}
 			for (const auto& object : reflectingObjects) {
+				if (object.isStatic) {
+					continue;
+				}
 				const auto rotation = b2Body_GetAngle(object.id);
 				const auto translation = toVec2(b2Body_GetPosition(object.id));
-				fillShape(cellTypeView, CellType::REFLECTING_WALL, translation, rotation, object.shape, simulationGridBounds, simulationGridSize);
+				addShapeWallSpans(wallSpans, translation, rotation, object.shape, simulationGridBounds, simulationGridSize, allCells, cellSize);
 			}
+			wallSpans.merge();
 		}
 
+		// In meters per second, so the waves take the same time to cross the room at every resolution.
+		const auto defaultSpeed = 30.0f * Constants::DEFAULT_CELL_SIZE;
 		{
-			const auto defaultSpeed = 30.0f * Constants::CELL_SIZE;
-			fill(speedSquared, pow(defaultSpeed, 2.0f));
-			auto speedSquaredView = view2d(speedSquared);
+			// The depth of a sponge layer is rounded to one of the levels, each of which is a material. There are more levels than cells across a layer of the default thickness.
+			const auto SPONGE_LAYER_LEVEL_COUNT = 64;
+			// The background and the sponge levels always get their own entries, so how many the objects can use doesn't depend on the boundary conditions.
+			const auto MAX_OBJECT_MATERIAL_COUNT = MAX_WAVE_MATERIAL_COUNT - 1 - SPONGE_LAYER_LEVEL_COUNT;
+			// Equal materials share an index.
+			waveMaterials.clear();
+			i64 objectMaterialCount = 0;
+			objectsWithoutMaterialCount = 0;
+			auto materialIndex = [&](WaveMaterial material, bool isObject) {
+				for (i64 i = 0; i < i64(waveMaterials.size()); i++) {
+					if (waveMaterials[i] == material) {
+						return u8(i);
+					}
+				}
+				if (isObject) {
+					// Past the limit the objects get the background material.
+					if (objectMaterialCount == MAX_OBJECT_MATERIAL_COUNT) {
+						objectsWithoutMaterialCount++;
+						return u8(0);
+					}
+					objectMaterialCount++;
+				}
+				waveMaterials.push_back(material);
+				return u8(waveMaterials.size() - 1);
+			};
+			waveMaterial.fill(materialIndex(WaveMaterial{ .speedSquared = pow(defaultSpeed, 2.0f), .damping = 0.0f }, false));
+
+			const auto& s = simulationSettings;
+			const auto thickness = f32(s.spongeLayerThickness);
+			// The damping grows with the square of the depth into the layer. Weaker damping lets the waves come back out of the layer and stronger damping reflects them at its inner side. The strength was picked by measuring the reflections of a pulse.
+			const auto maxDamping = 16.0f * defaultSpeed / (thickness * cellSize);
+			auto depth = [&](i64 position, i64 size, SimulationBoundaryCondition low, SimulationBoundaryCondition high) {
+				const auto t = std::max(
+					low == SimulationBoundaryCondition::SPONGE_LAYER ? (thickness + 0.5f - f32(position)) / thickness : 0.0f,
+					high == SimulationBoundaryCondition::SPONGE_LAYER ? (f32(position) - (f32(size - 1) - thickness - 0.5f)) / thickness : 0.0f);
+				return std::clamp(t, 0.0f, 1.0f);
+			};
+			std::array<i32, SPONGE_LAYER_LEVEL_COUNT + 1> levelMaterial;
+			levelMaterial.fill(-1);
+			// The depth is measured from the outer side of the ghost cells, which are the edges of the simulated grid.
+			const auto ghost = waveMaterial.ghostWidth();
+			const auto conditions = boundaryConditions();
+			for (i64 y = 0; y < simulationGridSize.y; y++) {
+				const auto depthY = depth(y, simulationGridSize.y, conditions.bottom, conditions.top);
+				for (i64 x = 0; x < simulationGridSize.x; x++) {
+					const auto t = std::max(depthY, depth(x, simulationGridSize.x, conditions.left, conditions.right));
+					const auto level = i64(std::round(t * SPONGE_LAYER_LEVEL_COUNT));
+					if (level == 0) {
+						continue;
+					}
+					if (levelMaterial[level] == -1) {
+						const auto levelT = f32(level) / SPONGE_LAYER_LEVEL_COUNT;
+						levelMaterial[level] = materialIndex(WaveMaterial{ .speedSquared = pow(defaultSpeed, 2.0f), .damping = maxDamping * levelT * levelT }, false);
+					}
+					waveMaterial(x - ghost, y - ghost) = u8(levelMaterial[level]);
+				}
+			}
+
+			// Each cell has one material, so the objects drawn later replace the ones below them.
 			for (const auto& object : transmissiveObjects) {
 				if (object.matchBackgroundSpeedOfTransmission) {
 					continue;
 				}
-				const auto speedOfTransmitionSquared = pow(object.speedOfTransmition, 2.0f);
+				const auto material = materialIndex(WaveMaterial{ .speedSquared = pow(object.speedOfTransmition, 2.0f), .damping = 0.0f }, true);
+				const auto rotation = b2Body_GetAngle(object.id);
+				const auto translation = toVec2(b2Body_GetPosition(object.id));
+				fillShape(waveMaterial, material, translation, rotation, object.shape, simulationGridBounds, simulationGridSize, cellSize);
+			}
+			for (const auto& object : dampingObjects) {
+				const auto material = materialIndex(WaveMaterial{ .speedSquared = pow(defaultSpeed, 2.0f), .damping = object.damping }, true);
 				const auto rotation = b2Body_GetAngle(object.id);
 				const auto translation = toVec2(b2Body_GetPosition(object.id));
-				fillShape(speedSquaredView, speedOfTransmitionSquared, translation, rotation, object.shape, simulationGridBounds, simulationGridSize);
+				fillShape(waveMaterial, material, translation, rotation, object.shape, simulationGridBounds, simulationGridSize, cellSize);
 			}
 		}
 
-		for (i64 i = 0; i < simulationSettings.waveEquationSimulationSubStepCount; i++) {
-			waveSimulationUpdate(simulationDt / simulationSettings.waveEquationSimulationSubStepCount);
+		const auto isImplicit = simulationSettings.waveIntegrator == SimulationWaveIntegrator::ADI;
+		if (isImplicit && simulationSettings.automaticWaveEquationSimulationSubStepCount) {
+			waveSubsteps = StableSubsteps{ .count = 1, .stable = true };
+		} else if (simulationSettings.automaticWaveEquationSimulationSubStepCount) {
+			waveSubsteps = stableSubstepCount(&waveMaterial(-1, -1), waveMaterials.data(), i64(waveMaterials.size()), wallSpans, simulationGridSize.x, simulationGridSize.y, waveMaterial.pitch(), simulationDt, cellSize, MAX_WAVE_EQUATION_SIMULATION_SUB_STEP_COUNT);
+		} else {
+			waveSubsteps = StableSubsteps{ .count = simulationSettings.waveEquationSimulationSubStepCount, .stable = true };
+		}
+		// The tiles can only take as many substeps at once as the power of 2 dividing the count. The tiles layout used while following the camera doesn't use local time stepping.
+		if (waveSolverSettings.localTimeStepping && simulationSettings.automaticWaveEquationSimulationSubStepCount && !isImplicit && !simulationFollowsCamera(simulationSettings)) {
+			const auto powerOf2Count = i32(std::bit_ceil(u32(waveSubsteps.count)));
+			if (powerOf2Count <= MAX_WAVE_EQUATION_SIMULATION_SUB_STEP_COUNT) {
+				waveSubsteps.count = powerOf2Count;
+			}
 		}
+		waveSimulationUpdate(simulationDt / waveSubsteps.count, waveSubsteps.count);
 	}
 
 	render(renderer, grid3dScale, hideGui);
@@ -388,6 +662,35 @@ bool Simulation::gui() {
 	
 	ImGui::SeparatorText("simulation");
 	simulationSettingsGui(simulationSettings);
+	if (simulationSettings.automaticWaveEquationSimulationSubStepCount) {
+		ImGui::Text("wave simulation substeps: %d", waveSubsteps.count);
+		if (waveSolverSettings.localTimeStepping && simulationSettings.waveIntegrator != SimulationWaveIntegrator::ADI && !simulationFollowsCamera(simulationSettings)) {
+			ImGui::TextWrapped("Local time stepping rounds the count up to a power of 2 when it stays within %d.", MAX_WAVE_EQUATION_SIMULATION_SUB_STEP_COUNT);
+		}
+		if (!waveSubsteps.stable) {
+			ImGui::TextWrapped("The fastest material needs more than %d substeps, the simulation is unstable.", MAX_WAVE_EQUATION_SIMULATION_SUB_STEP_COUNT);
+		}
+	}
+
+	ImGui::SeparatorText("solver");
+	waveSolverSettingsGui(waveSolverSettings);
+	if (waveField.layout == WaveFieldLayout::TILES) {
+		ImGui::Text("stored tiles: %d / %d", i32(waveField.storedTileCount), i32(waveField.tileCountX * waveField.tileCountY));
+		if (simulationFollowsCamera(simulationSettings) && (waveSolverSettings.localTimeStepping || waveSolverSettings.maxTemporalBlockDepth > 1)) {
+			ImGui::TextWrapped("Local time stepping and temporal blocking aren't used while the simulation follows the camera.");
+		} else if (waveSolverSettings.maxTemporalBlockDepth > 1) {
+			ImGui::TextWrapped("Temporal blocking isn't used while most of the grid is walls and only the open tiles are stored.");
+		}
+	} else if (waveSolverSettings.localTimeStepping) {
+		ImGui::Text("time step levels: %d", waveSolver.timeStepLevelCount);
+	}
+	if (waveStorageFormatProblemMessage != nullptr) {
+		ImGui::TextWrapped("Using f32, because %s.", waveStorageFormatProblemMessage);
+	}
+	if (objectsWithoutMaterialCount > 0) {
+		ImGui::TextWrapped("%d objects are simulated as the background, because the level has too many different materials.", i32(objectsWithoutMaterialCount));
+	}
+	waveStencilDispersionGui(waveSolver.minCourantNumber);
 
 	ImGui::SeparatorText("display mode");
 	ImGui::TextDisabled("(?)");
@@ -400,103 +703,50 @@ bool Simulation::gui() {
 	return switchToEditor;
 }
 
-void Simulation::waveSimulationUpdate(f32 simulationDt) {
-
-	if (simulationSettings.topBoundaryCondition == SimulationBoundaryCondition::REFLECTING) {
-		for (i64 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-			cellType(xi, simulationGridSize.y - 1) = CellType::REFLECTING_WALL;
-		}
-	}
-	if (simulationSettings.bottomBoundaryCondition == SimulationBoundaryCondition::REFLECTING) {
-		for (i64 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-			cellType(xi, 0) = CellType::REFLECTING_WALL;
-		}
-	}
-	if (simulationSettings.leftBoundaryCondition == SimulationBoundaryCondition::REFLECTING) {
-		for (i64 yi = 0; yi < simulationGridSize.y; yi++) {
-			cellType(0, yi) = CellType::REFLECTING_WALL;
-		}
-	}
-	if (simulationSettings.rightBoundaryCondition == SimulationBoundaryCondition::REFLECTING) {
-		for (i64 yi = 0; yi < simulationGridSize.y; yi++) {
-			cellType(simulationGridSize.x - 1, yi) = CellType::REFLECTING_WALL;
-		}
-	}
-	
-	for (i32 yi = 0; yi < simulationGridSize.y; yi++) {
-		for (i32 xi = 0; xi < simulationGridSize.x; xi++) {
-			switch (cellType(xi, yi)) {
-			case CellType::EMPTY:
-				break;
+void Simulation::waveSimulationUpdate(f32 substepDt, i32 substepCount) {
+	// The geometry is rasterized again before every update.
+	// Uses the Courant numbers from the previous update.
+	waveStorageFormatProblemMessage = waveStorageFormatProblem(waveSolverSettings.storageFormat, waveSolver.minCourantNumber, maxEmitterStrength());
+	waveField.setFormat(waveStorageFormatProblemMessage == nullptr ? waveSolverSettings.storageFormat : WaveStorageFormat::F32);
+	waveField.setLayout(waveFieldLayout());
+	waveSolver.updateCoefficients(waveField, &waveMaterial(-1, -1), waveMaterials.data(), i64(waveMaterials.size()), wallSpans, waveMaterial.pitch(), substepDt, cellSize);
 
-			case CellType::REFLECTING_WALL:
-				// Dirichlet boundary conditions
-				u(xi, yi) = 0.0f;
-				// This shouldn't do anything.
-				u_t(xi, yi) = 0.0f;
-			}
-		}
-	}
-
-	for (i32 yi = 1; yi < simulationGridSize.y - 1; yi++) {
-		for (i32 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-
-			const auto laplacianU = (u(xi + 1, yi) + u(xi - 1, yi) + u(xi, yi + 1) + u(xi, yi - 1) - 4.0f * u(xi, yi)) / (Constants::CELL_SIZE * Constants::CELL_SIZE);
-
-			u_t(xi, yi) += laplacianU * speedSquared(xi, yi) * simulationDt;
-		}
-	}
-
-#define CALCULATE_U_T(xPos, yPos, normalDifference) \
-	u_t(xPos, yPos) = sqrt(speedSquared(xPos, yPos)) * ((normalDifference) / Constants::CELL_SIZE)
-	
-	if (simulationSettings.bottomBoundaryCondition == SimulationBoundaryCondition::ABSORBING) {
-		for (i32 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-			CALCULATE_U_T(xi, 1, u(xi, 2) - u(xi, 1));
-		}
-	}
-
-	if (simulationSettings.topBoundaryCondition == SimulationBoundaryCondition::ABSORBING) {
-		for (i32 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-			CALCULATE_U_T(xi, simulationGridSize.y - 2, u(xi, simulationGridSize.y - 3) - u(xi, simulationGridSize.y - 2));
-		}
-	}
-
-	if (simulationSettings.leftBoundaryCondition == SimulationBoundaryCondition::ABSORBING) {
-		for (i32 yi = 1; yi < simulationGridSize.y - 1; yi++) {
-			CALCULATE_U_T(1, yi, u(2, yi) - u(1, yi));
-		}
-	}
-
-	if (simulationSettings.rightBoundaryCondition == SimulationBoundaryCondition::ABSORBING) {
-		for (i32 yi = 1; yi < simulationGridSize.y - 1; yi++) {
-			CALCULATE_U_T(simulationGridSize.x - 2, yi, u(simulationGridSize.x - 3, yi) - u(simulationGridSize.x - 2, yi));
-		}
-	}
-#undef CALCULATE_U_T
-	for (i32 yi = 1; yi < simulationGridSize.y - 1; yi++) {
-		for (i32 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-			u(xi, yi) += simulationDt * u_t(xi, yi);
-		}
-	}
+	auto dampingScale = [&](f32 dampingPerSecond) {
+		return exp(substepDt * log(dampingPerSecond));
+	};
 
-	if (simulationSettings.dampingPerSecond != 1.0f) {
-		const auto scale = exp(simulationDt * log(simulationSettings.dampingPerSecond));
-		for (i32 yi = 1; yi < simulationGridSize.y - 1; yi++) {
-			for (i32 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-				u(xi, yi) *= scale;
-			}
-		}
-	}
+	waveSolver.threadPool.setThreadCount(waveSolverSettings.threadCount);
+	waveSolver.setTileSize(waveSolverSettings.tileSize);
+	waveSolver.maxTimeStepLevel = waveSolverSettings.localTimeStepping ? WaveSolver::MAX_TIME_STEP_LEVEL : 0;
+	waveSolver.alternatingDirectionImplicit = simulationSettings.waveIntegrator == SimulationWaveIntegrator::ADI;
+	const auto conditions = boundaryConditions();
+	waveSolver.setBoundaryConditions(WaveBoundaryConditions{
+		.topAbsorbing = conditions.top == SimulationBoundaryCondition::ABSORBING,
+		.bottomAbsorbing = conditions.bottom == SimulationBoundaryCondition::ABSORBING,
+		.leftAbsorbing = conditions.left == SimulationBoundaryCondition::ABSORBING,
+		.rightAbsorbing = conditions.right == SimulationBoundaryCondition::ABSORBING,
+	});
+	waveSolver.setPerfectlyMatchedLayers(WavePerfectlyMatchedLayers{
+		.top = conditions.top == SimulationBoundaryCondition::PERFECTLY_MATCHED_LAYER,
+		.bottom = conditions.bottom == SimulationBoundaryCondition::PERFECTLY_MATCHED_LAYER,
+		.left = conditions.left == SimulationBoundaryCondition::PERFECTLY_MATCHED_LAYER,
+		.right = conditions.right == SimulationBoundaryCondition::PERFECTLY_MATCHED_LAYER,
+		.thickness = simulationSettings.perfectlyMatchedLayerThickness,
+	});
+	waveSolver.step(waveField, WaveStepParameters{
+		.dt = substepDt,
+		.uDampingScale = dampingScale(simulationSettings.dampingPerSecond),
+		.u_tDampingScale = dampingScale(simulationSettings.speedDampingPerSecond),
+		.tileSleepThreshold = waveSolverSettings.skipQuietTiles ? waveSolverSettings.tileSleepThreshold : 0.0f,
+	}, substepCount, waveSolverSettings.maxTemporalBlockDepth);
+}
 
-	if (simulationSettings.speedDampingPerSecond != 1.0f) {
-		const auto scale = exp(simulationDt * log(simulationSettings.speedDampingPerSecond));
-		for (i32 yi = 1; yi < simulationGridSize.y - 1; yi++) {
-			for (i32 xi = 1; xi < simulationGridSize.x - 1; xi++) {
-				u_t(xi, yi) *= scale;
-			}
-		}
+f32 Simulation::maxEmitterStrength() const {
+	auto result = std::abs(emitterStrengthSetting);
+	for (const auto& emitter : emitters) {
+		result = std::max(result, std::abs(emitter.strength));
 	}
+	return result;
 }
 
 void Simulation::render(GameRenderer& renderer, Vec3 grid3dScale, bool hideGui) {
@@ -516,22 +766,17 @@ void Simulation::render(GameRenderer& renderer, Vec3 grid3dScale, bool hideGui)
 				const auto simulationYi = displayYi + 1;
 
 				auto& pixel = debugDisplayGrid(displayXi, displayYi);
-				switch (cellType(simulationXi, simulationYi)) {
-				case CellType::EMPTY: {
+				if (wallSpans.isWall(simulationXi, simulationYi)) {
+					pixel = Pixel32(Vec3(0.5f));
+				} else {
 					// could smooth out the values before displaying
-					const auto color = Color3::scientificColoring(u(simulationXi, simulationYi), -5.0f, 5.0f);
+					const auto color = Color3::scientificColoring(waveField.uAt(simulationXi, simulationYi), -5.0f, 5.0f);
 					pixel = Pixel32(color);
-					break;
-				}
-
-				case CellType::REFLECTING_WALL:
-					pixel = Pixel32(Vec3(0.5f));
-					break;
 				}
 			}
 		}
 		debugDisplayTexture.bind();
-		updatePixelTexture(debugDisplayGrid.data(), debugDisplayGrid.sizeX(), debugDisplayGrid.sizeY());
+		updatePixelTexture(debugDisplayGrid.row(0), debugDisplayGrid.sizeX(), debugDisplayGrid.sizeY(), debugDisplayGrid.pitch());
 
 		const auto displayGridBounds = this->displayGridBounds();
 		const auto displayGridBoundsSize = displayGridBounds.size();
@@ -542,52 +787,24 @@ void Simulation::render(GameRenderer& renderer, Vec3 grid3dScale, bool hideGui)
 		renderer.waveShader.setTexture("waveTexture", 0, debugDisplayTexture);
 		drawInstances(renderer.waveVao, renderer.gfx.instancesVbo, View<const WaveInstance>(&display, 1), quad2dPtDrawInstances);
 	} else {
+		waveField.loadU(displayGridTemp.row(0), displayGridTemp.pitch(), 1, 1, 1 + displayGridTemp.sizeX(), 1 + displayGridTemp.sizeY());
 		for (i32 displayYi = 0; displayYi < debugDisplayGrid.sizeY(); displayYi++) {
 			for (i32 displayXi = 0; displayXi < debugDisplayGrid.sizeX(); displayXi++) {
-				const auto simulationXi = displayXi + 1;
-				const auto simulationYi = displayYi + 1;
 				const auto min = -5.0f;
 				const auto max = 5.0f;
-				displayGridTemp(displayXi, displayYi) = (u(simulationXi, simulationYi) - min) / (max - min);
-				//displayGridTemp(displayXi, displayYi) = (u_t(simulationXi, simulationYi) - min) / (max - min);
+				displayGridTemp(displayXi, displayYi) = (displayGridTemp(displayXi, displayYi) - min) / (max - min);
+				//const auto u_t = (waveField.uAt(simulationXi, simulationYi) - waveField.u_prevAt(simulationXi, simulationYi)) / waveSolver.coefficientsDt;
+				//displayGridTemp(displayXi, displayYi) = (u_t - min) / (max - min);
 			}
 		}
 
 		//ImGui::Checkbox("applyBlurToDisplayGrid", &applyBlurToDisplayGrid);
 
 		if (applyBlurToDisplayGrid) {
-			for (i32 displayYi = 0; displayYi < debugDisplayGrid.sizeY(); displayYi++) {
-				for (i32 displayXi = 0; displayXi < debugDisplayGrid.sizeX(); displayXi++) {
-					f32 sum = 0.0f;
-					f32 kernel[3][3] = {
-						{ 1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f },
-						{ 2.0f / 16.0f, 4.0f / 16.0f, 2.0f / 16.0f },
-						{ 1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f },
-					};
-
-					for (i64 j = 0; j < 3; j++) {
-						for (i64 i = 0; i < 3; i++) {
-							i64 x = displayXi + (i - 1);
-							i64 y = displayYi + (j - 1);
-
-							if (x < 0) {
-								x = 0;
-							}
-							if (y < 0) {
-								y = 0;
-							}
-							if (x >= displayGrid.sizeX()) {
-								x = displayGrid.sizeX() - 1;
-							}
-							if (y >= displayGrid.sizeY()) {
-								y = displayGrid.sizeY() - 1;
-							}
-
-							sum += displayGridTemp(x, y) * kernel[i][j];
-						}
-					}
-					displayGrid(displayXi, displayYi) = sum;
-				}
+			// The edges are blurred with the edge cells repeated.
+			displayGridTemp.clampGhostCells();
+			for (i64 displayYi = 0; displayYi < displayGrid.sizeY(); displayYi++) {
+				displayBlurRow(displayGrid.row(displayYi), displayGridTemp.row(displayYi - 1), displayGridTemp.row(displayYi), displayGridTemp.row(displayYi + 1), displayGrid.sizeX());
 			}
 		} else {
 			for (i32 displayYi = 0; displayYi < debugDisplayGrid.sizeY(); displayYi++) {
@@ -598,7 +815,7 @@ void Simulation::render(GameRenderer& renderer, Vec3 grid3dScale, bool hideGui)
 		}
 
 		displayTexture.bind();
-		updateFloatTexture(displayGrid.data(), displayGrid.sizeX(), displayGrid.sizeY());
+		updateFloatTexture(displayGrid.row(0), displayGrid.sizeX(), displayGrid.sizeY(), displayGrid.pitch());
 
 		const auto displayGridBounds = this->displayGridBounds();
 		const auto displayGridBoundsSize = displayGridBounds.size();
@@ -694,6 +911,10 @@ void Simulation::render(GameRenderer& renderer, Vec3 grid3dScale, bool hideGui)
 			renderShape(object.id, object.shape, true);
 		}
 
+		for (const auto& object : dampingObjects) {
+			renderShape(object.id, object.shape, true);
+		}
+
 		for (const auto& emitter : emitters) {
 			renderer.emitter(getEmitterPos(emitter), false, false);
 		}
@@ -729,9 +950,11 @@ void Simulation::render(GameRenderer& renderer, Vec3 grid3dScale, bool hideGui)
 
 			auto addVertex = [&](Vec2 worldPos, f32 y) -> i32 {
 				const auto color = renderer.insideColor(Vec4(GameRenderer::defaultColor, 1.0f), isStatic).xyz();
-				const auto scale = Vec2(1.0f) / displayGridBounds().size() * Vec2(grid3dScale.x, grid3dScale.z);
+				const auto displayBounds = displayGridBounds();
+				const auto scale = Vec2(1.0f) / displayBounds.size() * Vec2(grid3dScale.x, grid3dScale.z);
+				const auto gridPos = worldPos - displayBounds.min;
 				return display3d.addVertex(Vertex3Pnc{
-					.position = Vec3(worldPos.x * scale.x, y, worldPos.y * scale.y),
+					.position = Vec3(gridPos.x * scale.x, y, gridPos.y * scale.y),
 					.normal = Vec3(0.0f, 1.0f, 0.0f),
 					.color = color
 				});
@@ -824,14 +1047,18 @@ void Simulation::runEmitter(Vec2 pos, f32 strength, bool oscillate, f32 period,
 
 	f32 finalStrength;
 	if (oscillate) {
-		finalStrength = sin((simulationElapsed / period + phaseOffset) * TAU<f32>);
+		finalStrength = f32(sin((simulationElapsed / period + phaseOffset) * TAU<f64>));
 		//strength = std::max(0.0f, ) * emitter.strength;
 		finalStrength *= strength;
 	} else {
 		finalStrength = strength;
 	}
 
-	fillCircle(u, gridPosition, 3, finalStrength);
+	const auto radius = 3;
+	forEachCellInCircle(simulationGridSize, gridPosition, radius, [&](i64 x, i64 y) {
+		waveField.setUKeepingVelocity(x, y, finalStrength);
+	});
+	waveSolver.wakeCells(gridPosition.x - radius, gridPosition.y - radius, gridPosition.x + radius, gridPosition.y + radius);
 }
 
 void Simulation::reset() {
@@ -850,22 +1077,49 @@ void Simulation::reset() {
 	}
 	transmissiveObjects.clear();
 
+	for (auto& object : dampingObjects) {
+		b2DestroyBody(object.id);
+	}
+	dampingObjects.clear();
+	staticWallSpansOutdated = true;
+
 	emitters.clear();
 
-	fill(u, 0.0f);
-	fill(u_t, 0.0f);
+	waveField.clear();
+
+	simulationElapsed = 0.0;
+}
+
+WaveFieldLayout Simulation::waveFieldLayout() {
+	// The tiles are slower to step than the rows, but scrollGrid only has to renumber them.
+	if (simulationFollowsCamera(simulationSettings)) {
+		return WaveFieldLayout::TILES;
+	}
+	if (simulationSettings.waveIntegrator == SimulationWaveIntegrator::ADI || waveSolverSettings.localTimeStepping) {
+		return WaveFieldLayout::ROWS;
+	}
+	// The rows skip the walls too, so the tiles only save memory. On a 2048x2048 grid they step about as fast as the rows with temporal blocking once at most a quarter of them are open.
+	// Going back to the rows only above a third keeps the moving objects from switching the layout every update.
+	const auto openCount = findOpenWaveFieldTiles(openWaveFieldTiles, wallSpans, waveField.sizeX, waveField.sizeY);
+	const auto tileCount = i64(openWaveFieldTiles.size());
+	if (waveField.layout == WaveFieldLayout::TILES) {
+		return openCount * 3 > tileCount ? WaveFieldLayout::ROWS : WaveFieldLayout::TILES;
+	}
+	return openCount * 4 <= tileCount ? WaveFieldLayout::TILES : WaveFieldLayout::ROWS;
+}
 
-	simulationElapsed = 0.0f;
+Aabb Simulation::roomBounds() const {
+	return Constants::gridBounds(Vec2T<i64>(simulationSettings.gridSize.x, simulationSettings.gridSize.y), simulationSettings.cellSize);
 }
 
 Aabb Simulation::displayGridBounds() const {
-	return Constants::gridBounds(debugDisplayGrid.size());
+	return Constants::gridBounds(Vec2T<i64>(debugDisplayGrid.sizeX(), debugDisplayGrid.sizeY()), cellSize).translated(gridOrigin);
 }
 
 Aabb Simulation::simulationGridBounds() const {
 	auto bounds = displayGridBounds();
-	bounds.min -= Vec2(Constants::CELL_SIZE);
-	bounds.min += Vec2(Constants::CELL_SIZE);
+	bounds.min -= Vec2(cellSize);
+	bounds.min += Vec2(cellSize);
 	return bounds;
 }
 
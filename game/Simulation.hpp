@@ -1,6 +1,5 @@
 #pragma once
 
-#include <Array2d.hpp>
 #include <List.hpp>
 #include <game/GameInput.hpp>
 #include <game/Box2d.hpp>
@@ -8,11 +7,17 @@
 #include <game/GameRenderer.hpp>
 #include <game/SimulationSettings.hpp>
 #include <game/InputButton.hpp>
+#include <game/PaddedArray2d.hpp>
 #include <game/SimulationDisplay3d.hpp>
-
-enum class CellType : u8 {
-	EMPTY,
-	REFLECTING_WALL
+#include <game/WaveSolver.hpp>
+#include <game/WaveSolverSettings.hpp>
+#include <game/GridUtils.hpp>
+
+struct SimulationBoundaryConditions {
+	SimulationBoundaryCondition top;
+	SimulationBoundaryCondition bottom;
+	SimulationBoundaryCondition left;
+	SimulationBoundaryCondition right;
 };
 
 struct Simulation {
@@ -34,24 +39,49 @@ struct Simulation {
 	Result update(GameRenderer& renderer, const GameInput& input, bool hideGui);
 	bool gui();
 
-	void waveSimulationUpdate(f32 simulationDt);
+	void waveSimulationUpdate(f32 substepDt, i32 substepCount);
 	void render(GameRenderer& renderer, Vec3 grid3dScale, bool hideGui);
 
 	void runEmitter(Vec2 pos, f32 strength, bool oscillate, f32 period, f32 phaseOffset);
 
 
 	void reset();
-
+	// Sets the thread count and the tile size measured for the size of the grid, which is only measured the first time.
+	void tuneWaveSolverForGrid();
+	// Resizes the grids and textures to gridSize cells without the edge cells, starting at origin, and clears the waves.
+	void resizeGrid(Vec2 origin, Vec2T<i64> gridSize, f32 cellSize);
+	// Moves the grid of the same size to origin, which is a whole number of wave field tiles away, keeping the waves in the cells that stay in it.
+	void scrollGrid(Vec2 origin);
+	// Adds the walls of the static reflecting objects in cells.
+	void addStaticWallSpans(WaveWallSpans& walls, const GridAabb& cells);
+	void createBoundaries();
+
+	// The cells of the scene that are simulated with the settings.
+	SimulationGridDomain gridDomain() const;
+	// The scene continues past the edges of a window following the camera and past the edges of a fitted grid that are inside the room, so they absorb the waves whatever the setting.
+	SimulationBoundaryConditions boundaryConditions() const;
+	// The tiles only store the parts of the grid that aren't walls, but they are stepped without temporal blocking and local time stepping.
+	WaveFieldLayout waveFieldLayout();
+
+	Aabb roomBounds() const;
 	Aabb displayGridBounds() const;
 	Aabb simulationGridBounds() const;
 	Vec3 grid3dScale();
 
-	f32 simulationElapsed;
+	// f64, because after a few hours an f32 can't represent the time with enough precision for the emitter phases.
+	f64 simulationElapsed;
 
 	Vec2T<i64> simulationGridSize;
+	// The grid is resized to gridDomain() at the start of the update.
+	f32 cellSize;
+	// The corner of the first cell that isn't an edge cell.
+	Vec2 gridOrigin;
+	// The bounds of the level the simulation was started from, used by fitGridToLevel.
+	std::optional<Aabb> levelBounds;
 
 	b2WorldId world;
 
+	// Null while following the camera.
 	b2BodyId boundariesBodyId;
 	b2BodyId backgroundBodyId;
 
@@ -76,6 +106,7 @@ struct Simulation {
 	struct ReflectingObject {
 		b2BodyId id;
 		ShapeInfo shape;
+		bool isStatic;
 	};
 	List<ReflectingObject> reflectingObjects;
 
@@ -88,6 +119,13 @@ struct Simulation {
 	};
 	List<TransmissiveObject> transmissiveObjects;
 
+	struct DampingObject {
+		b2BodyId id;
+		ShapeInfo shape;
+		f32 damping;
+	};
+	List<DampingObject> dampingObjects;
+
 	struct Emitter {
 		b2BodyId body;
 		Vec2 positionRelativeToBody;
@@ -126,22 +164,38 @@ struct Simulation {
 	Camera camera;
 
 	SimulationSettings simulationSettings;
+	WaveSolverSettings waveSolverSettings;
 
 	f32 emitterStrengthSetting = 100.0f;
 	bool emitterOscillateSetting = false;
 	f32 emitterPeriodSetting = 1.0f;
 	f32 emitterPhaseOffsetSetting = 0.0f;
 
-	Array2d<f32> u;
-	Array2d<f32> u_t;
-	Array2d<CellType> cellType;
-	Array2d<f32> speedSquared;
-
-	Array2d<Pixel32> debugDisplayGrid;
+	WaveField waveField;
+	// The reflecting walls in the field's cells, rasterized again every update.
+	WaveWallSpans wallSpans;
+	// The part of wallSpans from the static objects, which is only rasterized again where cells enter the grid.
+	WaveWallSpans staticWallSpans;
+	bool staticWallSpansOutdated = true;
+	std::vector<u8> openWaveFieldTiles;
+	// The index into waveMaterials of each cell. The materials are the background, the depths of the sponge layers and the transmissive and damping objects.
+	PaddedArray2d<u8> waveMaterial;
+	std::vector<WaveMaterial> waveMaterials;
+	// The objects whose material didn't fit in the table.
+	i64 objectsWithoutMaterialCount = 0;
+	WaveSolver waveSolver;
+	// Set when the storage format in the settings can't be used and f32 is used instead.
+	const char* waveStorageFormatProblemMessage = nullptr;
+	// The substeps used by the last update.
+	StableSubsteps waveSubsteps{ .count = 1, .stable = true };
+	f32 maxEmitterStrength() const;
+
+	PaddedArray2d<Pixel32> debugDisplayGrid;
 	Texture debugDisplayTexture;
 
-	Array2d<f32> displayGrid;
-	Array2d<f32> displayGridTemp;
+	PaddedArray2d<f32> displayGrid;
+	// Has ghost cells for the blur.
+	PaddedArray2d<f32> displayGridTemp;
 	bool applyBlurToDisplayGrid = true;
 	Texture displayTexture;
 
@@ -1,23 +1,59 @@
 #include <game/SimulationSettings.hpp>
 #include <Gui.hpp>
 #include <game/Shared.hpp>
+#include <game/Constants.hpp>
+#include <game/GridUtils.hpp>
+#include <cmath>
 
 SimulationSettings SimulationSettings::makeDefault() {
 	return SimulationSettings{
 		.paused = false,
 		.timeScale = 1.0f,
 		.rigidbodySimulationSubStepCount = 4,
+		.waveIntegrator = SimulationWaveIntegrator::LEAPFROG,
+		.automaticWaveEquationSimulationSubStepCount = true,
 		.waveEquationSimulationSubStepCount = 1,
 		.topBoundaryCondition = SimulationBoundaryCondition::REFLECTING,
 		.bottomBoundaryCondition = SimulationBoundaryCondition::REFLECTING,
 		.leftBoundaryCondition = SimulationBoundaryCondition::REFLECTING,
 		.rightBoundaryCondition = SimulationBoundaryCondition::REFLECTING,
+		.perfectlyMatchedLayerThickness = 16,
+		.spongeLayerThickness = 32,
 		.dampingPerSecond = 0.90f,
 		.speedDampingPerSecond = 0.90f,
-		.gravity = Vec2(0.0f, -10.0f)
+		.gravity = Vec2(0.0f, -10.0f),
+		.gridSize = Vec2T<i32>(i32(Constants::DEFAULT_GRID_SIZE.x), i32(Constants::DEFAULT_GRID_SIZE.y)),
+		.cellSize = Constants::DEFAULT_CELL_SIZE,
+		.fitGridToLevel = false,
+		.gridMargin = 2.0f,
+		.followCamera = false,
 	};
 }
 
+bool simulationFollowsCamera(const SimulationSettings& settings) {
+	return settings.followCamera && settings.waveIntegrator != SimulationWaveIntegrator::ADI;
+}
+
+SimulationGridDomain fittedSimulationGridDomain(const SimulationSettings& settings, const std::optional<Aabb>& levelBounds) {
+	const auto sceneSize = Vec2T<i64>(settings.gridSize.x, settings.gridSize.y);
+	if (!settings.fitGridToLevel || !levelBounds.has_value()) {
+		return SimulationGridDomain{ .origin = Vec2(0.0f), .size = sceneSize };
+	}
+
+	auto bounds = *levelBounds;
+	bounds.min -= Vec2(settings.gridMargin);
+	bounds.max += Vec2(settings.gridMargin);
+	// Uses the cells of the whole scene, so the objects cover the same cells as without fitting.
+	const auto cells = aabbToClampedGridAabb(bounds, Constants::gridBounds(sceneSize, settings.cellSize), sceneSize);
+	auto fit = [](i64 min, i64 max, i64 sceneSize) {
+		const auto size = std::min(std::max(max - min + 1, i64(MIN_SIMULATION_GRID_SIZE)), sceneSize);
+		return std::pair(std::clamp(min, i64(0), sceneSize - size), size);
+	};
+	const auto [minX, sizeX] = fit(cells.min.x, cells.max.x, sceneSize.x);
+	const auto [minY, sizeY] = fit(cells.min.y, cells.max.y, sceneSize.y);
+	return SimulationGridDomain{ .origin = Vec2(f32(minX), f32(minY)) * settings.cellSize, .size = Vec2T<i64>(sizeX, sizeY) };
+}
+
 void simulationSettingsGui(SimulationSettings& settings) {
 	auto boundaryConditionCombo = [](const char* text, SimulationBoundaryCondition& value) {
 		struct Entry {
@@ -30,6 +66,8 @@ void simulationSettingsGui(SimulationSettings& settings) {
 				using enum SimulationBoundaryCondition;
 			case REFLECTING: return "reflecting";
 			case ABSORBING: return "absorbing";
+			case PERFECTLY_MATCHED_LAYER: return "perfectly matched layer";
+			case SPONGE_LAYER: return "sponge layer";
 			}
 
 			CHECK_NOT_REACHED();
@@ -38,7 +76,9 @@ void simulationSettingsGui(SimulationSettings& settings) {
 
 		Entry entries[]{
 			{ SimulationBoundaryCondition::REFLECTING },
-			{ SimulationBoundaryCondition::ABSORBING }
+			{ SimulationBoundaryCondition::ABSORBING },
+			{ SimulationBoundaryCondition::PERFECTLY_MATCHED_LAYER },
+			{ SimulationBoundaryCondition::SPONGE_LAYER }
 		};
 		const char* preview = boundaryConditionName(value);
 
@@ -59,9 +99,37 @@ void simulationSettingsGui(SimulationSettings& settings) {
 		}
 	};
 
+	auto waveIntegratorName = [](SimulationWaveIntegrator integrator) {
+		switch (integrator) {
+			using enum SimulationWaveIntegrator;
+		case LEAPFROG: return "leapfrog";
+		case ADI: return "implicit (ADI)";
+		}
+
+		CHECK_NOT_REACHED();
+		return "";
+	};
+
 	if (gameBeginPropertyEditor("simulation settings")) {
-		Gui::inputI32("wave simulation substeps", settings.waveEquationSimulationSubStepCount);
-		settings.waveEquationSimulationSubStepCount = std::clamp(settings.waveEquationSimulationSubStepCount, 1, 20);
+		Gui::leafNodeBegin("wave integrator");
+		if (ImGui::BeginCombo(Gui::prependWithHashHash("wave integrator"), waveIntegratorName(settings.waveIntegrator))) {
+			for (const auto integrator : { SimulationWaveIntegrator::LEAPFROG, SimulationWaveIntegrator::ADI }) {
+				const auto isSelected = integrator == settings.waveIntegrator;
+				if (ImGui::Selectable(waveIntegratorName(integrator), isSelected)) {
+					settings.waveIntegrator = integrator;
+				}
+				if (isSelected) {
+					ImGui::SetItemDefaultFocus();
+				}
+			}
+			ImGui::EndCombo();
+		}
+
+		Gui::checkbox("automatic wave simulation substeps", settings.automaticWaveEquationSimulationSubStepCount);
+		if (!settings.automaticWaveEquationSimulationSubStepCount) {
+			Gui::inputI32("wave simulation substeps", settings.waveEquationSimulationSubStepCount);
+			settings.waveEquationSimulationSubStepCount = std::clamp(settings.waveEquationSimulationSubStepCount, 1, MAX_WAVE_EQUATION_SIMULATION_SUB_STEP_COUNT);
+		}
 
 		Gui::inputI32("rigidbody simulation substeps", settings.rigidbodySimulationSubStepCount);
 		settings.rigidbodySimulationSubStepCount = std::clamp(settings.rigidbodySimulationSubStepCount, 1, 20);
@@ -84,12 +152,45 @@ void simulationSettingsGui(SimulationSettings& settings) {
 	}
 	Gui::popPropertyEditor();
 
+	ImGui::SeparatorText("grid");
+	if (gameBeginPropertyEditor("grid")) {
+		// Changing the cell size keeps the size of the scene and changes the number of cells.
+		const auto oldCellSize = settings.cellSize;
+		Gui::inputFloat("cell size", settings.cellSize);
+		settings.cellSize = std::clamp(settings.cellSize, MIN_SIMULATION_CELL_SIZE, MAX_SIMULATION_CELL_SIZE);
+		if (settings.cellSize != oldCellSize) {
+			settings.gridSize.x = i32(std::round(f32(settings.gridSize.x) * oldCellSize / settings.cellSize));
+			settings.gridSize.y = i32(std::round(f32(settings.gridSize.y) * oldCellSize / settings.cellSize));
+		}
+		Gui::inputI32("cells x", settings.gridSize.x);
+		settings.gridSize.x = std::clamp(settings.gridSize.x, MIN_SIMULATION_GRID_SIZE, MAX_SIMULATION_GRID_SIZE);
+		Gui::inputI32("cells y", settings.gridSize.y);
+		settings.gridSize.y = std::clamp(settings.gridSize.y, MIN_SIMULATION_GRID_SIZE, MAX_SIMULATION_GRID_SIZE);
+		if (settings.waveIntegrator != SimulationWaveIntegrator::ADI) {
+			Gui::checkbox("follow camera", settings.followCamera);
+		}
+		const auto followsCamera = simulationFollowsCamera(settings);
+		if (!followsCamera) {
+			Gui::checkbox("fit to level", settings.fitGridToLevel);
+		}
+		if (!followsCamera && settings.fitGridToLevel) {
+			Gui::inputFloat("margin", settings.gridMargin);
+			settings.gridMargin = std::max(settings.gridMargin, 0.0f);
+		}
+		Gui::endPropertyEditor();
+	}
+	Gui::popPropertyEditor();
+
 	ImGui::SeparatorText("boundary conditions");
 	if (gameBeginPropertyEditor("boundary conditions")) {
 		boundaryConditionCombo("top", settings.topBoundaryCondition);
 		boundaryConditionCombo("bottom", settings.bottomBoundaryCondition);
 		boundaryConditionCombo("left", settings.leftBoundaryCondition);
 		boundaryConditionCombo("right", settings.rightBoundaryCondition);
+		Gui::inputI32("perfectly matched layer thickness", settings.perfectlyMatchedLayerThickness);
+		settings.perfectlyMatchedLayerThickness = std::clamp(settings.perfectlyMatchedLayerThickness, 2, 64);
+		Gui::inputI32("sponge layer thickness", settings.spongeLayerThickness);
+		settings.spongeLayerThickness = std::clamp(settings.spongeLayerThickness, 2, 128);
 		Gui::endPropertyEditor();
 	}
 	Gui::popPropertyEditor();
@@ -106,4 +207,10 @@ void simulationSettingsGui(SimulationSettings& settings) {
 	if (ImGui::Button("set all to absorbing")) {
 		setAllTo(SimulationBoundaryCondition::ABSORBING);
 	}
+	if (ImGui::Button("set all to perfectly matched layer")) {
+		setAllTo(SimulationBoundaryCondition::PERFECTLY_MATCHED_LAYER);
+	}
+	if (ImGui::Button("set all to sponge layer")) {
+		setAllTo(SimulationBoundaryCondition::SPONGE_LAYER);
+	}
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <engine/Math/Vec2.hpp>
+#include <engine/Math/Aabb.hpp>
+#include <optional>
 
 // Should the settings be shared between the simulation and the editor or should they be restored to the ones in the editor when the scene is switched?
 // If the former then how should undo redo work?
@@ -8,6 +10,17 @@
 enum class SimulationBoundaryCondition {
 	REFLECTING,
 	ABSORBING,
+	// Absorbs the waves in a layer of cells along the edge. Reflects much less than ABSORBING, especially at grazing angles.
+	PERFECTLY_MATCHED_LAYER,
+	// Damps the waves more and more towards the edge. Needs a thicker layer than PERFECTLY_MATCHED_LAYER for the same reflections, but also works with the implicit integrator.
+	SPONGE_LAYER,
+};
+
+enum class SimulationWaveIntegrator {
+	// Explicit, needs enough substeps to stay stable.
+	LEAPFROG,
+	// Alternating direction implicit. Stable with any number of substeps, but the short waves are slowed down.
+	ADI,
 };
 
 struct SimulationSettings {
@@ -16,17 +29,48 @@ struct SimulationSettings {
 	bool paused;
 	f32 timeScale;
 	i32 rigidbodySimulationSubStepCount;
+	SimulationWaveIntegrator waveIntegrator;
+	// When set the wave equation is split into the fewest substeps that keep it stable and waveEquationSimulationSubStepCount isn't used. The implicit integrator then takes a single substep.
+	bool automaticWaveEquationSimulationSubStepCount;
 	i32 waveEquationSimulationSubStepCount;
 
 	SimulationBoundaryCondition topBoundaryCondition;
 	SimulationBoundaryCondition bottomBoundaryCondition;
 	SimulationBoundaryCondition leftBoundaryCondition;
 	SimulationBoundaryCondition rightBoundaryCondition;
+	// In cells. The layers are inside the grid, so they cover the edges of the scene.
+	i32 perfectlyMatchedLayerThickness;
+	i32 spongeLayerThickness;
 
 	f32 dampingPerSecond;
 	f32 speedDampingPerSecond;
 
 	Vec2 gravity;
+
+	// The cells of the scene, without the cells at the edges. The scene covers gridSize * cellSize meters.
+	Vec2T<i32> gridSize;
+	f32 cellSize;
+	// Only simulates the cells of the scene within gridMargin meters of the bodies and the emitters. The edges of the simulated cells that are inside the room absorb the waves, the bodies are still kept in the room.
+	bool fitGridToLevel;
+	f32 gridMargin;
+	// Simulates a window of gridSize cells centered on the camera instead of the scene. The window moves by whole tiles of the wave field and its edges absorb the waves. Not used with the implicit integrator, which needs the rows layout that can't move without copying the cells.
+	bool followCamera;
+};
+
+constexpr i32 MAX_WAVE_EQUATION_SIMULATION_SUB_STEP_COUNT = 20;
+constexpr i32 MIN_SIMULATION_GRID_SIZE = 16;
+constexpr i32 MAX_SIMULATION_GRID_SIZE = 4096;
+constexpr f32 MIN_SIMULATION_CELL_SIZE = 0.01f;
+constexpr f32 MAX_SIMULATION_CELL_SIZE = 1.0f;
+
+bool simulationFollowsCamera(const SimulationSettings& settings);
+
+struct SimulationGridDomain {
+	// The corner of the first cell.
+	Vec2 origin;
+	Vec2T<i64> size;
 };
+// The cells of the scene simulated when not following the camera. levelBounds are the bounds of the bodies and the emitters.
+SimulationGridDomain fittedSimulationGridDomain(const SimulationSettings& settings, const std::optional<Aabb>& levelBounds);
 
 void simulationSettingsGui(SimulationSettings& settings);
\ No newline at end of file
@@ -5,6 +5,16 @@ Texture makeFloatTexture(i64 sizeX, i64 sizeY) {
 	auto result = Texture::generate();
 
 	result.bind();
+	resizeFloatTexture(sizeX, sizeY);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	return result;
+}
+
+void resizeFloatTexture(i64 sizeX, i64 sizeY) {
 	glTexImage2D(
 		GL_TEXTURE_2D,
 		0,
@@ -16,22 +26,28 @@ Texture makeFloatTexture(i64 sizeX, i64 sizeY) {
 		GL_FLOAT,
 		nullptr
 	);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	return result;
 }
 
-void updateFloatTexture(f32* data, i64 sizeX, i64 sizeY) {
+void updateFloatTexture(f32* data, i64 sizeX, i64 sizeY, i64 pitch) {
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, GLint(pitch));
 	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sizeX, sizeY, GL_RED, GL_FLOAT, data);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 }
 
 Texture makePixelTexture(i64 sizeX, i64 sizeY) {
 	auto result = Texture::generate();
 
 	result.bind();
+	resizePixelTexture(sizeX, sizeY);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+	return result;
+}
+
+void resizePixelTexture(i64 sizeX, i64 sizeY) {
 	glTexImage2D(
 		GL_TEXTURE_2D,
 		0,
@@ -43,14 +59,10 @@ Texture makePixelTexture(i64 sizeX, i64 sizeY) {
 		GL_UNSIGNED_BYTE,
 		nullptr
 	);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-	return result;
 }
 
-void updatePixelTexture(void* data, i64 sizeX, i64 sizeY) {
+void updatePixelTexture(void* data, i64 sizeX, i64 sizeY, i64 pitch) {
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, GLint(pitch));
 	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, sizeX, sizeY, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 }
@@ -3,7 +3,11 @@
 #include <engine/Graphics/Texture.hpp>
 
 Texture makeFloatTexture(i64 sizeX, i64 sizeY);
-void updateFloatTexture(f32* data, i64 sizeX, i64 sizeY);
+// Reallocates the bound texture, keeping the texture object and its parameters.
+void resizeFloatTexture(i64 sizeX, i64 sizeY);
+// The rows of data are pitch elements apart.
+void updateFloatTexture(f32* data, i64 sizeX, i64 sizeY, i64 pitch);
 
 Texture makePixelTexture(i64 sizeX, i64 sizeY);
-void updatePixelTexture(void* data, i64 sizeX, i64 sizeY);
+void resizePixelTexture(i64 sizeX, i64 sizeY);
+void updatePixelTexture(void* data, i64 sizeX, i64 sizeY, i64 pitch);
@@ -0,0 +1,98 @@
+#include <game/ThreadPool.hpp>
+#include <algorithm>
+
+ThreadPool::ThreadPool() {}
+
+ThreadPool::~ThreadPool() {
+	stopWorkers();
+}
+
+void ThreadPool::setThreadCount(i32 threadCount) {
+	threadCount = std::max(threadCount, 1);
+	if (threadCount == this->threadCount()) {
+		return;
+	}
+
+	stopWorkers();
+	quit = false;
+	for (i32 i = 1; i < threadCount; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, i, jobGeneration));
+	}
+}
+
+i32 ThreadPool::threadCount() const {
+	return i32(workers.size()) + 1;
+}
+
+void ThreadPool::run(const std::function<void(i32)>& job) {
+	if (workers.empty()) {
+		job(0);
+		return;
+	}
+
+	{
+		std::unique_lock lock(mutex);
+		this->job = &job;
+		workersRunning = i32(workers.size());
+		jobGeneration++;
+	}
+	jobAvailable.notify_all();
+
+	job(0);
+
+	std::unique_lock lock(mutex);
+	jobFinished.wait(lock, [this] { return workersRunning == 0; });
+	this->job = nullptr;
+}
+
+void ThreadPool::barrier() {
+	if (workers.empty()) {
+		return;
+	}
+
+	std::unique_lock lock(barrierMutex);
+	const auto generation = barrierGeneration;
+	barrierArrivedCount++;
+	if (barrierArrivedCount == threadCount()) {
+		barrierArrivedCount = 0;
+		barrierGeneration++;
+		barrierReached.notify_all();
+		return;
+	}
+	barrierReached.wait(lock, [&] { return barrierGeneration != generation; });
+}
+
+void ThreadPool::workerLoop(i32 threadIndex, u64 lastJobGeneration) {
+	for (;;) {
+		const std::function<void(i32)>* currentJob;
+		{
+			std::unique_lock lock(mutex);
+			jobAvailable.wait(lock, [&] { return quit || jobGeneration != lastJobGeneration; });
+			if (quit) {
+				return;
+			}
+			lastJobGeneration = jobGeneration;
+			currentJob = job;
+		}
+
+		(*currentJob)(threadIndex);
+
+		std::unique_lock lock(mutex);
+		workersRunning--;
+		if (workersRunning == 0) {
+			jobFinished.notify_one();
+		}
+	}
+}
+
+void ThreadPool::stopWorkers() {
+	{
+		std::unique_lock lock(mutex);
+		quit = true;
+	}
+	jobAvailable.notify_all();
+	for (auto& worker : workers) {
+		worker.join();
+	}
+	workers.clear();
+}
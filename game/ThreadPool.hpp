@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Types.hpp>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+// Persistent worker threads. The thread calling run also executes the job as thread 0, so threadCount includes it.
+struct ThreadPool {
+	ThreadPool();
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void setThreadCount(i32 threadCount);
+	i32 threadCount() const;
+
+	// Calls job(threadIndex) on every thread and returns once all of them have finished.
+	void run(const std::function<void(i32)>& job);
+	// Blocks until every thread executing the current job has called it.
+	void barrier();
+
+private:
+	void workerLoop(i32 threadIndex, u64 lastJobGeneration);
+	void stopWorkers();
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	std::condition_variable jobFinished;
+	const std::function<void(i32)>* job = nullptr;
+	u64 jobGeneration = 0;
+	i32 workersRunning = 0;
+	bool quit = false;
+
+	std::mutex barrierMutex;
+	std::condition_variable barrierReached;
+	u64 barrierGeneration = 0;
+	i32 barrierArrivedCount = 0;
+};
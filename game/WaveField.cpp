@@ -0,0 +1,408 @@
+#include <game/WaveField.hpp>
+#include <algorithm>
+#include <cmath>
+
+const char* waveStorageFormatName(WaveStorageFormat format) {
+	switch (format) {
+		using enum WaveStorageFormat;
+	case F32: return "f32";
+	case F16: return "f16";
+	case BF16: return "bf16";
+	case F64: return "f64";
+	}
+	return "";
+}
+
+const char* waveFieldLayoutName(WaveFieldLayout layout) {
+	switch (layout) {
+		using enum WaveFieldLayout;
+	case ROWS: return "rows";
+	case TILES: return "tiles";
+	}
+	return "";
+}
+
+i64 waveStorageFormatSize(WaveStorageFormat format) {
+	return withWaveStorageType(format, []<typename T>(T) {
+		return i64(sizeof(T));
+	});
+}
+
+const char* waveStorageFormatProblem(WaveStorageFormat format, f32 minCourantNumber, f32 maxAmplitude) {
+	// Half of the distance between neighbouring values relative to the value.
+	f32 unitRoundoff;
+	switch (format) {
+		using enum WaveStorageFormat;
+	case F32: return nullptr;
+	case F64: return nullptr;
+	case F16: unitRoundoff = std::ldexp(1.0f, -11); break;
+	case BF16: unitRoundoff = std::ldexp(1.0f, -8); break;
+	default: return nullptr;
+	}
+
+	// Found on a pulse in a closed room. The velocity is u - u_prev, so the rounding matters more the slower the waves are.
+	const auto MAX_ERROR_GROWTH = 0.04f;
+	if (unitRoundoff > MAX_ERROR_GROWTH * minCourantNumber * minCourantNumber * minCourantNumber) {
+		return "the wave speed is too low or there are too many substeps for the precision";
+	}
+
+	// Interference can make the waves a lot bigger than the emitters.
+	const auto AMPLITUDE_HEADROOM = 16.0f;
+	const auto F16_MAX = 65504.0f;
+	if (format == WaveStorageFormat::F16 && maxAmplitude * AMPLITUDE_HEADROOM > F16_MAX) {
+		return "the emitters are too strong for the range";
+	}
+	return nullptr;
+}
+
+WaveField::WaveField(i64 sizeX, i64 sizeY, WaveStorageFormat format)
+	: format(format)
+	, tilePitch(WAVE_FIELD_TILE_SIZE + 2 * WAVE_STENCIL_RADIUS)
+	// Each tile starts on a cache line in all the arrays, the smallest cells are the 1 byte materials.
+	, tileCellCount(roundUpToMultiple(tilePitch * tilePitch, CACHE_LINE_SIZE)) {
+	const auto tableSize = withWaveStorageType(format, []<typename T>(T) {
+		return WAVE_MATERIAL_COUNT * i64(sizeof(WaveComputeType<T>));
+	});
+	coefficientTableBytes.resize(tableSize, 0);
+	dampingTableBytes.resize(tableSize, 0);
+	resize(sizeX, sizeY);
+}
+
+void WaveField::resize(i64 newSizeX, i64 newSizeY) {
+	sizeX = newSizeX;
+	sizeY = newSizeY;
+	pitch = roundUpToMultiple(sizeX, CACHE_LINE_SIZE);
+	tileCountX = (sizeX + WAVE_FIELD_TILE_SIZE - 1) / WAVE_FIELD_TILE_SIZE;
+	tileCountY = (sizeY + WAVE_FIELD_TILE_SIZE - 1) / WAVE_FIELD_TILE_SIZE;
+
+	// Interleaves the bits of x and y.
+	auto zOrder = [](i64 x, i64 y) {
+		u64 result = 0;
+		for (i64 bit = 0; bit < 32; bit++) {
+			result |= ((u64(x) >> bit) & 1) << (2 * bit);
+			result |= ((u64(y) >> bit) & 1) << (2 * bit + 1);
+		}
+		return result;
+	};
+	zOrderTiles.resize(tileCountX * tileCountY);
+	for (i64 i = 0; i < i64(zOrderTiles.size()); i++) {
+		zOrderTiles[i] = i;
+	}
+	std::sort(zOrderTiles.begin(), zOrderTiles.end(), [&](i64 a, i64 b) {
+		return zOrder(a % tileCountX, a / tileCountX) < zOrder(b % tileCountX, b / tileCountX);
+	});
+	// The cells are all walls, so with TILES none of the tiles are stored.
+	storeTiles(std::vector<u8>(tileCountX * tileCountY, layout == WaveFieldLayout::ROWS));
+
+	// assign only allocates when the arrays grow past their capacity.
+	const auto cellCount = layout == WaveFieldLayout::ROWS ? pitch * sizeY : storedTileCount * tileCellCount;
+	uBytes.assign(cellCount * waveStorageFormatSize(format), 0);
+	u_prevBytes.assign(cellCount * waveStorageFormatSize(format), 0);
+	materials.assign(cellCount, WAVE_WALL_MATERIAL);
+	std::fill(layerMemoryBytes.begin(), layerMemoryBytes.end(), 0);
+}
+
+void WaveField::scroll(i64 tileShiftX, i64 tileShiftY) {
+	if (tileShiftX == 0 && tileShiftY == 0) {
+		return;
+	}
+	if (layout == WaveFieldLayout::ROWS) {
+		resize(sizeX, sizeY);
+		return;
+	}
+	// The layers stay at the edges of the window, so their memory belongs to other cells now.
+	std::fill(layerMemoryBytes.begin(), layerMemoryBytes.end(), 0);
+	const auto elementSize = waveStorageFormatSize(format);
+
+	std::vector<i64> newTileOrigins(tileOrigins.size(), WAVE_FIELD_NO_TILE);
+	std::vector<u8> kept(tileOrigins.size(), false);
+	std::vector<u8> entered(tileOrigins.size(), false);
+	for (i64 tileY = 0; tileY < tileCountY; tileY++) {
+		for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+			const auto fromX = tileX + tileShiftX;
+			const auto fromY = tileY + tileShiftY;
+			if (fromX < 0 || fromX >= tileCountX || fromY < 0 || fromY >= tileCountY) {
+				entered[tileY * tileCountX + tileX] = true;
+				continue;
+			}
+			newTileOrigins[tileY * tileCountX + tileX] = tileOrigin(fromX, fromY);
+			kept[fromY * tileCountX + fromX] = true;
+		}
+	}
+	// As many tiles leave the window as enter it. The ones that weren't stored stay that way until setStoredTiles.
+	i64 left = 0;
+	for (i64 tile = 0; tile < i64(tileOrigins.size()); tile++) {
+		if (!entered[tile]) {
+			continue;
+		}
+		while (kept[left]) {
+			left++;
+		}
+		newTileOrigins[tile] = tileOrigins[left];
+		left++;
+	}
+	tileOrigins = std::move(newTileOrigins);
+
+	// Clears the cells of the tiles outside of the field and the ghost cells, which were copied from the old neighbours. The tiles that entered are cleared whole.
+	const auto r = WAVE_STENCIL_RADIUS;
+	for (i64 tile = 0; tile < i64(tileOrigins.size()); tile++) {
+		const auto origin = tileOrigins[tile];
+		if (origin == WAVE_FIELD_NO_TILE) {
+			continue;
+		}
+		const auto tileX = tile % tileCountX;
+		const auto tileY = tile / tileCountX;
+		const auto width = entered[tile] ? 0 : std::min(WAVE_FIELD_TILE_SIZE, sizeX - tileX * WAVE_FIELD_TILE_SIZE);
+		const auto height = entered[tile] ? 0 : std::min(WAVE_FIELD_TILE_SIZE, sizeY - tileY * WAVE_FIELD_TILE_SIZE);
+		auto clear = [&](CacheLineBytes& bytes, i64 elementSize, u8 fill) {
+			for (i64 row = -r; row < WAVE_FIELD_TILE_SIZE + r; row++) {
+				const auto rowStart = bytes.data() + (origin + row * tilePitch - r) * elementSize;
+				if (row < 0 || row >= height) {
+					std::fill_n(rowStart, tilePitch * elementSize, fill);
+				} else {
+					std::fill_n(rowStart, r * elementSize, fill);
+					std::fill_n(rowStart + (r + width) * elementSize, (tilePitch - r - width) * elementSize, fill);
+				}
+			}
+		};
+		clear(uBytes, elementSize, 0);
+		clear(u_prevBytes, elementSize, 0);
+		clear(materials, 1, WAVE_WALL_MATERIAL);
+	}
+}
+
+void WaveField::setFormat(WaveStorageFormat newFormat) {
+	if (newFormat == format) {
+		return;
+	}
+
+	const auto count = i64(uBytes.size()) / waveStorageFormatSize(format);
+	for (auto bytes : { &uBytes, &u_prevBytes }) {
+		CacheLineBytes converted(count * waveStorageFormatSize(newFormat));
+		withWaveStorageType(format, [&]<typename From>(From) {
+			withWaveStorageType(newFormat, [&]<typename To>(To) {
+				const auto from = elements<From>(*bytes);
+				const auto to = elements<To>(converted);
+				for (i64 i = 0; i < count; i++) {
+					to[i] = storeWaveValue<To>(WaveComputeType<To>(loadWaveValue(from[i])));
+				}
+			});
+		});
+		*bytes = std::move(converted);
+	}
+	for (auto bytes : { &coefficientTableBytes, &dampingTableBytes, &layerMemoryBytes }) {
+		withWaveStorageType(format, [&]<typename From>(From) {
+			withWaveStorageType(newFormat, [&]<typename To>(To) {
+				using FromScalar = WaveComputeType<From>;
+				using ToScalar = WaveComputeType<To>;
+				const auto valueCount = i64(bytes->size() / sizeof(FromScalar));
+				std::vector<u8> converted(valueCount * sizeof(ToScalar));
+				const auto from = elements<FromScalar>(*bytes);
+				const auto to = elements<ToScalar>(converted);
+				for (i64 i = 0; i < valueCount; i++) {
+					to[i] = ToScalar(from[i]);
+				}
+				*bytes = std::move(converted);
+			});
+		});
+	}
+	format = newFormat;
+}
+
+void WaveField::setLayout(WaveFieldLayout newLayout) {
+	if (newLayout == layout) {
+		return;
+	}
+
+	const auto oldLayout = layout;
+	const auto oldTileOrigins = tileOrigins;
+	std::vector<u8> stored(tileCountX * tileCountY, true);
+	if (newLayout == WaveFieldLayout::TILES) {
+		// Like setStoredTiles, the tiles whose cells are all walls aren't stored.
+		std::fill(stored.begin(), stored.end(), false);
+		for (i64 y = 0; y < sizeY; y++) {
+			for (i64 x = 0; x < sizeX; x++) {
+				if (materials[y * pitch + x] != WAVE_WALL_MATERIAL) {
+					stored[(y / WAVE_FIELD_TILE_SIZE) * tileCountX + x / WAVE_FIELD_TILE_SIZE] = true;
+				}
+			}
+		}
+	}
+	layout = newLayout;
+	storeTiles(stored);
+	const auto cellCount = layout == WaveFieldLayout::ROWS ? pitch * sizeY : storedTileCount * tileCellCount;
+
+	// The index of the first cell of the row y of the tile.
+	auto rowIndex = [&](WaveFieldLayout rowLayout, const std::vector<i64>& origins, i64 tileX, i64 tileY, i64 y) {
+		if (rowLayout == WaveFieldLayout::ROWS) {
+			return y * pitch + tileX * WAVE_FIELD_TILE_SIZE;
+		}
+		const auto origin = origins[tileY * tileCountX + tileX];
+		return origin == WAVE_FIELD_NO_TILE ? WAVE_FIELD_NO_TILE : origin + (y - tileY * WAVE_FIELD_TILE_SIZE) * tilePitch;
+	};
+	auto move = [&](CacheLineBytes& bytes, i64 elementSize, u8 fill) {
+		CacheLineBytes moved(cellCount * elementSize, fill);
+		for (i64 tileY = 0; tileY < tileCountY; tileY++) {
+			for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+				const auto width = std::min(WAVE_FIELD_TILE_SIZE, sizeX - tileX * WAVE_FIELD_TILE_SIZE);
+				for (i64 y = tileY * WAVE_FIELD_TILE_SIZE; y < std::min((tileY + 1) * WAVE_FIELD_TILE_SIZE, sizeY); y++) {
+					const auto from = rowIndex(oldLayout, oldTileOrigins, tileX, tileY, y);
+					const auto to = rowIndex(layout, tileOrigins, tileX, tileY, y);
+					if (from != WAVE_FIELD_NO_TILE && to != WAVE_FIELD_NO_TILE) {
+						std::copy_n(bytes.begin() + from * elementSize, width * elementSize, moved.begin() + to * elementSize);
+					}
+				}
+			}
+		}
+		bytes = std::move(moved);
+	};
+	move(uBytes, waveStorageFormatSize(format), 0);
+	move(u_prevBytes, waveStorageFormatSize(format), 0);
+	move(materials, 1, WAVE_WALL_MATERIAL);
+}
+
+void WaveField::storeTiles(const std::vector<u8>& stored) {
+	tileOrigins.assign(zOrderTiles.size(), WAVE_FIELD_NO_TILE);
+	storedTileCount = 0;
+	for (const auto tile : zOrderTiles) {
+		if (stored[tile]) {
+			tileOrigins[tile] = storedTileCount * tileCellCount + WAVE_STENCIL_RADIUS * tilePitch + WAVE_STENCIL_RADIUS;
+			storedTileCount++;
+		}
+	}
+}
+
+void WaveField::setStoredTiles(const std::vector<u8>& stored) {
+	if (layout != WaveFieldLayout::TILES) {
+		return;
+	}
+	bool changed = false;
+	for (i64 tile = 0; tile < i64(tileOrigins.size()); tile++) {
+		changed |= (tileOrigins[tile] != WAVE_FIELD_NO_TILE) != bool(stored[tile]);
+	}
+	if (!changed) {
+		return;
+	}
+
+	const auto oldTileOrigins = tileOrigins;
+	storeTiles(stored);
+	// Only the cells inside the tiles are kept. The ghost cells next to the dropped tiles have to be 0.
+	auto move = [&](CacheLineBytes& bytes, i64 elementSize, u8 fill) {
+		CacheLineBytes moved(storedTileCount * tileCellCount * elementSize, fill);
+		for (i64 tile = 0; tile < i64(tileOrigins.size()); tile++) {
+			if (oldTileOrigins[tile] == WAVE_FIELD_NO_TILE || tileOrigins[tile] == WAVE_FIELD_NO_TILE) {
+				continue;
+			}
+			for (i64 row = 0; row < WAVE_FIELD_TILE_SIZE; row++) {
+				const auto from = bytes.begin() + (oldTileOrigins[tile] + row * tilePitch) * elementSize;
+				std::copy_n(from, WAVE_FIELD_TILE_SIZE * elementSize, moved.begin() + (tileOrigins[tile] + row * tilePitch) * elementSize);
+			}
+		}
+		bytes = std::move(moved);
+	};
+	move(uBytes, waveStorageFormatSize(format), 0);
+	move(u_prevBytes, waveStorageFormatSize(format), 0);
+	move(materials, 1, WAVE_WALL_MATERIAL);
+}
+
+bool WaveField::isCellStored(i64 x, i64 y) const {
+	return layout == WaveFieldLayout::ROWS || tileOrigin(x / WAVE_FIELD_TILE_SIZE, y / WAVE_FIELD_TILE_SIZE) != WAVE_FIELD_NO_TILE;
+}
+
+i64 WaveField::cellIndex(i64 x, i64 y) const {
+	if (layout == WaveFieldLayout::ROWS) {
+		return y * pitch + x;
+	}
+	const auto tileX = x / WAVE_FIELD_TILE_SIZE;
+	const auto tileY = y / WAVE_FIELD_TILE_SIZE;
+	return tileOrigin(tileX, tileY) + (y - tileY * WAVE_FIELD_TILE_SIZE) * tilePitch + x - tileX * WAVE_FIELD_TILE_SIZE;
+}
+
+void WaveField::loadU(f32* out, i64 outPitch, i64 xBegin, i64 yBegin, i64 xEnd, i64 yEnd) const {
+	if (layout == WaveFieldLayout::TILES) {
+		for (auto y = yBegin; y < yEnd; y++) {
+			std::fill_n(out + (y - yBegin) * outPitch, xEnd - xBegin, 0.0f);
+		}
+	}
+	withWaveStorageType(format, [&]<typename T>(T) {
+		const auto u = elements<T>(uBytes);
+		forEachRun(xBegin, yBegin, xEnd, yEnd, [&](i64 x, i64 y, i64 index, i64 count) {
+			const auto row = out + (y - yBegin) * outPitch + x - xBegin;
+			for (i64 i = 0; i < count; i++) {
+				row[i] = f32(loadWaveValue(u[index + i]));
+			}
+		});
+	});
+}
+
+i64 WaveField::tileOrigin(i64 tileX, i64 tileY) const {
+	return tileOrigins[tileY * tileCountX + tileX];
+}
+
+void WaveField::copyTileGhostCells(CacheLineBytes& bytes, i64 tileX, i64 tileY) const {
+	const auto elementSize = waveStorageFormatSize(format);
+	const auto r = WAVE_STENCIL_RADIUS;
+	const auto size = WAVE_FIELD_TILE_SIZE;
+	const auto origin = tileOrigin(tileX, tileY);
+	// Copies count cells of each of the rowCount rows starting at the cells at the offsets from the tile origins.
+	auto copy = [&](i64 fromOrigin, i64 fromOffset, i64 toOffset, i64 count, i64 rowCount) {
+		for (i64 row = 0; row < rowCount; row++) {
+			const auto from = bytes.begin() + (fromOrigin + fromOffset + row * tilePitch) * elementSize;
+			std::copy_n(from, count * elementSize, bytes.begin() + (origin + toOffset + row * tilePitch) * elementSize);
+		}
+	};
+	// The stencil only reaches along the axes, so the corners aren't needed.
+	if (tileX > 0 && tileOrigin(tileX - 1, tileY) != WAVE_FIELD_NO_TILE) {
+		copy(tileOrigin(tileX - 1, tileY), size - r, -r, r, size);
+	}
+	if (tileX + 1 < tileCountX && tileOrigin(tileX + 1, tileY) != WAVE_FIELD_NO_TILE) {
+		copy(tileOrigin(tileX + 1, tileY), 0, size, r, size);
+	}
+	if (tileY > 0 && tileOrigin(tileX, tileY - 1) != WAVE_FIELD_NO_TILE) {
+		copy(tileOrigin(tileX, tileY - 1), (size - r) * tilePitch, -r * tilePitch, size, r);
+	}
+	if (tileY + 1 < tileCountY && tileOrigin(tileX, tileY + 1) != WAVE_FIELD_NO_TILE) {
+		copy(tileOrigin(tileX, tileY + 1), 0, size * tilePitch, size, r);
+	}
+}
+
+f32 WaveField::uAt(i64 x, i64 y) const {
+	if (!isCellStored(x, y)) {
+		return 0.0f;
+	}
+	return withWaveStorageType(format, [&]<typename T>(T) {
+		return f32(loadWaveValue(elements<T>(uBytes)[cellIndex(x, y)]));
+	});
+}
+
+f32 WaveField::u_prevAt(i64 x, i64 y) const {
+	if (!isCellStored(x, y)) {
+		return 0.0f;
+	}
+	return withWaveStorageType(format, [&]<typename T>(T) {
+		return f32(loadWaveValue(elements<T>(u_prevBytes)[cellIndex(x, y)]));
+	});
+}
+
+u8 WaveField::materialAt(i64 x, i64 y) const {
+	return isCellStored(x, y) ? materials[cellIndex(x, y)] : WAVE_WALL_MATERIAL;
+}
+
+void WaveField::setUKeepingVelocity(i64 x, i64 y, f32 value) {
+	if (!isCellStored(x, y)) {
+		return;
+	}
+	withWaveStorageType(format, [&]<typename T>(T) {
+		const auto i = cellIndex(x, y);
+		auto& u = elements<T>(uBytes)[i];
+		auto& u_prev = elements<T>(u_prevBytes)[i];
+		u_prev = storeWaveValue<T>(loadWaveValue(u_prev) + value - loadWaveValue(u));
+		u = storeWaveValue<T>(value);
+	});
+}
+
+void WaveField::clear() {
+	std::fill(uBytes.begin(), uBytes.end(), 0);
+	std::fill(u_prevBytes.begin(), u_prevBytes.end(), 0);
+	std::fill(layerMemoryBytes.begin(), layerMemoryBytes.end(), 0);
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <Types.hpp>
+#include <game/HalfFloat.hpp>
+#include <game/PaddedArray2d.hpp>
+#include <game/WaveStencil.hpp>
+#include <type_traits>
+#include <vector>
+
+// All the formats store 0 as 0 bytes.
+enum class WaveStorageFormat : u8 {
+	F32,
+	F16,
+	BF16,
+	F64,
+};
+
+const char* waveStorageFormatName(WaveStorageFormat format);
+i64 waveStorageFormatSize(WaveStorageFormat format);
+
+// TILES stores the grid in Z-ordered tiles with ghost cells.
+// With TILES the tiles whose cells are all walls aren't stored.
+enum class WaveFieldLayout : u8 {
+	ROWS,
+	TILES,
+};
+
+const char* waveFieldLayoutName(WaveFieldLayout layout);
+
+constexpr i64 WAVE_FIELD_TILE_SIZE = 128;
+// The tileOrigin of the tiles that aren't stored.
+constexpr i64 WAVE_FIELD_NO_TILE = -1;
+
+// Calls function with a value of the type the format is stored as.
+template<typename Function>
+decltype(auto) withWaveStorageType(WaveStorageFormat format, Function function) {
+	switch (format) {
+	case WaveStorageFormat::F16: return function(F16{});
+	case WaveStorageFormat::BF16: return function(BF16{});
+	case WaveStorageFormat::F64: return function(f64{});
+	case WaveStorageFormat::F32: break;
+	}
+	return function(f32{});
+}
+
+// The values stored as f64 are computed in f64 and everything else in f32.
+template<typename T>
+using WaveComputeType = std::conditional_t<std::is_same_v<T, f64>, f64, f32>;
+
+template<typename T>
+WaveComputeType<T> loadWaveValue(T value) {
+	if constexpr (std::is_same_v<T, f64>) {
+		return value;
+	} else {
+		return toF32(value);
+	}
+}
+
+template<typename T>
+T storeWaveValue(WaveComputeType<T> value) {
+	if constexpr (std::is_same_v<T, f64>) {
+		return value;
+	} else {
+		return fromF32<T>(value);
+	}
+}
+
+constexpr i64 WAVE_MATERIAL_COUNT = 256;
+constexpr u8 WAVE_WALL_MATERIAL = 0;
+
+// Returns why the format can't be used or nullptr if it can.
+const char* waveStorageFormatProblem(WaveStorageFormat format, f32 minCourantNumber, f32 maxAmplitude);
+
+struct WaveField {
+	WaveField(i64 sizeX, i64 sizeY, WaveStorageFormat format);
+
+	// Converts the stored values.
+	void setFormat(WaveStorageFormat newFormat);
+	// Moves the cells. The ghost cells of the tiles are left at 0.
+	void setLayout(WaveFieldLayout newLayout);
+	// Clears the values and sets all the cells to walls, keeping the format and the layout. With TILES none of the tiles are stored until setStoredTiles.
+	void resize(i64 newSizeX, i64 newSizeY);
+	// Moves the cells by whole tiles, the ones moved in are cleared walls. With ROWS clears all the cells instead.
+	void scroll(i64 tileShiftX, i64 tileShiftY);
+	// With TILES only keeps the tiles with stored[tileY * tileCountX + tileX] set. The ones that aren't stored read as walls.
+	void setStoredTiles(const std::vector<u8>& stored);
+	// Sets tileOrigins to store the tiles with stored[tileY * tileCountX + tileX] set in Z-order, without moving the cells.
+	void storeTiles(const std::vector<u8>& stored);
+	bool isCellStored(i64 x, i64 y) const;
+
+	// The index of the cell in u, u_prev and materials.
+	i64 cellIndex(i64 x, i64 y) const;
+	// Calls function(x, index, count) for the runs of stored cells of row y in [xBegin, xEnd) that are consecutive in the arrays.
+	template<typename Function>
+	void forEachRowRun(i64 y, i64 xBegin, i64 xEnd, Function function) const;
+	// Like forEachRowRun, but goes through the tiles in Z-order with TILES.
+	template<typename Function>
+	void forEachRun(i64 xBegin, i64 yBegin, i64 xEnd, i64 yEnd, Function function) const;
+	// Copies u of the cells in [xBegin, xEnd) x [yBegin, yEnd) to out, whose rows are outPitch values apart.
+	void loadU(f32* out, i64 outPitch, i64 xBegin, i64 yBegin, i64 xEnd, i64 yEnd) const;
+	// The index of the cell (0, 0) of the tile, WAVE_FIELD_NO_TILE if it isn't stored.
+	i64 tileOrigin(i64 tileX, i64 tileY) const;
+	// bytes is uBytes or u_prevBytes.
+	void copyTileGhostCells(CacheLineBytes& bytes, i64 tileX, i64 tileY) const;
+
+	f32 uAt(i64 x, i64 y) const;
+	f32 u_prevAt(i64 x, i64 y) const;
+	u8 materialAt(i64 x, i64 y) const;
+	// Moves u_prev by the same amount, so the velocity doesn't change.
+	void setUKeepingVelocity(i64 x, i64 y, f32 value);
+	void clear();
+
+	template<typename T, typename Allocator>
+	static T* elements(std::vector<u8, Allocator>& bytes) {
+		return reinterpret_cast<T*>(bytes.data());
+	}
+
+	template<typename T, typename Allocator>
+	static const T* elements(const std::vector<u8, Allocator>& bytes) {
+		return reinterpret_cast<const T*>(bytes.data());
+	}
+
+	i64 sizeX;
+	i64 sizeY;
+	// sizeX rounded up to CACHE_LINE_SIZE, so that the rows start on cache lines in all the arrays, including the 1 byte materials.
+	i64 pitch;
+	WaveStorageFormat format;
+	WaveFieldLayout layout = WaveFieldLayout::ROWS;
+	// Used with TILES.
+	i64 tileCountX;
+	i64 tileCountY;
+	i64 tilePitch;
+	i64 tileCellCount;
+	// The index of the cell (0, 0) of each tile, by tileY * tileCountX + tileX.
+	std::vector<i64> tileOrigins;
+	i64 storedTileCount;
+	// The tiles in Z-order.
+	std::vector<i64> zOrderTiles;
+	// u from the current and the previous substep.
+	CacheLineBytes uBytes;
+	CacheLineBytes u_prevBytes;
+	// The index into the tables below of each cell. Calculated by WaveSolver::updateCoefficients.
+	CacheLineBytes materials;
+	// Indexed by the material, stored in the compute type of the format.
+	std::vector<u8> coefficientTableBytes;
+	std::vector<u8> dampingTableBytes;
+	// The materials are below materialCount.
+	i64 materialCount = 1;
+	// The memory of the cells of the perfectly matched layers.
+	std::vector<u8> layerMemoryBytes;
+};
+
+template<typename Function>
+void WaveField::forEachRowRun(i64 y, i64 xBegin, i64 xEnd, Function function) const {
+	if (layout == WaveFieldLayout::ROWS) {
+		if (xBegin < xEnd) {
+			function(xBegin, y * pitch + xBegin, xEnd - xBegin);
+		}
+		return;
+	}
+	const auto tileY = y / WAVE_FIELD_TILE_SIZE;
+	const auto rowOffset = (y - tileY * WAVE_FIELD_TILE_SIZE) * tilePitch;
+	for (auto x = xBegin; x < xEnd;) {
+		const auto tileX = x / WAVE_FIELD_TILE_SIZE;
+		const auto runEnd = std::min((tileX + 1) * WAVE_FIELD_TILE_SIZE, xEnd);
+		const auto origin = tileOrigins[tileY * tileCountX + tileX];
+		if (origin != WAVE_FIELD_NO_TILE) {
+			function(x, origin + rowOffset + x - tileX * WAVE_FIELD_TILE_SIZE, runEnd - x);
+		}
+		x = runEnd;
+	}
+}
+
+template<typename Function>
+void WaveField::forEachRun(i64 xBegin, i64 yBegin, i64 xEnd, i64 yEnd, Function function) const {
+	if (layout == WaveFieldLayout::ROWS) {
+		for (auto y = yBegin; y < yEnd && xBegin < xEnd; y++) {
+			function(xBegin, y, y * pitch + xBegin, xEnd - xBegin);
+		}
+		return;
+	}
+	for (const auto tile : zOrderTiles) {
+		const auto origin = tileOrigins[tile];
+		const auto tileX = tile % tileCountX;
+		const auto tileY = tile / tileCountX;
+		const auto runBegin = std::max(xBegin, tileX * WAVE_FIELD_TILE_SIZE);
+		const auto runEnd = std::min(xEnd, (tileX + 1) * WAVE_FIELD_TILE_SIZE);
+		if (origin == WAVE_FIELD_NO_TILE || runBegin >= runEnd) {
+			continue;
+		}
+		for (auto y = std::max(yBegin, tileY * WAVE_FIELD_TILE_SIZE); y < std::min(yEnd, (tileY + 1) * WAVE_FIELD_TILE_SIZE); y++) {
+			function(runBegin, y, origin + (y - tileY * WAVE_FIELD_TILE_SIZE) * tilePitch + runBegin - tileX * WAVE_FIELD_TILE_SIZE, runEnd - runBegin);
+		}
+	}
+}
@@ -0,0 +1,18 @@
+#include <game/WaveKernels.hpp>
+
+const WaveKernels& waveKernelsFor(InstructionSet instructionSet) {
+	switch (instructionSet) {
+		using enum InstructionSet;
+	case SCALAR: return waveKernelsScalar;
+	case SSE4_2: return waveKernelsSse4_2;
+	case AVX2: return waveKernelsAvx2;
+	case AVX512: return waveKernelsAvx512;
+	}
+	return waveKernelsScalar;
+}
+
+const WaveKernels* waveKernels = &waveKernelsFor(bestSupportedInstructionSet());
+
+const char* waveKernelsInstructionSetName() {
+	return instructionSetName(waveKernels->instructionSet);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <Types.hpp>
+#include <game/CpuFeatures.hpp>
+#include <game/WaveField.hpp>
+
+// Row kernels used by the wave solver, the display and the rasterizer.
+// Each kernel is compiled once per instruction set and the widest one the cpu supports is picked at startup.
+// The pointers point at the first cell of the range. The wave kernels also read the cells up to the stencil radius before and after the range in u.
+
+// The wave kernels for the grids stored as T. The values are converted to WaveComputeType<T> after loading and back before storing.
+// The per-cell coefficients are looked up in tables of WAVE_MATERIAL_COUNT entries by the cell's material index, so a row only reads a byte per cell for them. The indices are below materialCount, and the lookup is faster when there are only a few materials.
+template<typename T>
+struct WaveStepKernels {
+	using Scalar = WaveComputeType<T>;
+
+	// u_prev = u * uScale - u_prev * u_prevScale + laplacian(u) * coefficient[material] * laplacianScale, where coefficient = speedSquared * dt^2 / cellSize^2. The next u is written over u_prev, which is only read at the same cell.
+	// u[dy] points at the row dy rows above, for dy up to the stencil radius in both directions. The laplacian is of order WAVE_STENCIL_ORDER.
+	void (*leapfrogRow)(T* u_prev, const T* const* u, const u8* material, const Scalar* coefficient, i64 materialCount, Scalar uScale, Scalar u_prevScale, Scalar laplacianScale, i64 count);
+	// The same with the 5-point laplacian, which only reads the rows u[-1], u[0] and u[1].
+	void (*secondOrderLeapfrogRow)(T* u_prev, const T* const* u, const u8* material, const Scalar* coefficient, i64 materialCount, Scalar uScale, Scalar u_prevScale, Scalar laplacianScale, i64 count);
+	// uNext = (u + sqrt(coefficient) * courantScale * (uInside - u)) * scale, where sqrt(coefficient) = speed * dt / cellSize. Used on the cells next to an absorbing edge, uInside is the neighbour further from the edge. courantScale is the ratio of the substep to the one the coefficient was computed for.
+	void (*absorbingRow)(T* uNext, const T* u, const T* uInside, const u8* material, const Scalar* coefficient, i64 materialCount, Scalar courantScale, Scalar scale, i64 count);
+	// leapfrogRow with the 5-point laplacian computed in the stretched coordinates of a perfectly matched layer, d/dx~ = d/dx / (1 + damping / (d/dt)). The first derivatives on the edges between the cells and then the second derivatives are stretched by a recursive convolution in time, stretched = decay * (memory + difference), where decay = exp(-damping * dt).
+	// The arrays at k * memoryStride and k * decayStride for k = 0, 1, 2 are of the left edge, the cell and the right edge. k = 3, 4, 5 are the same along y from below. The edges of neighbouring cells keep separate copies of their memory, which stay equal, so a cell only reads and writes its own memory.
+	void (*perfectlyMatchedLayerRow)(T* u_prev, const T* const* u, const u8* material, const Scalar* coefficient, i64 materialCount, Scalar* memory, i64 memoryStride, const Scalar* decay, i64 decayStride, Scalar uScale, Scalar u_prevScale, Scalar laplacianScale, i64 count);
+	// uNext = uNext - damping[material] * (uNext - u * uScale), which removes the part damping of the velocity uNext was given. uScale is the scale u was multiplied by apart from the velocity. Applied after the cells are updated, only where damping isn't 0.
+	void (*dampingRow)(T* uNext, const T* u, const u8* material, const Scalar* damping, i64 materialCount, Scalar uScale, i64 count);
+
+	// Used by the alternating direction implicit step, which solves tridiagonal systems along the rows and the columns of the grid with the Thomas algorithm. Row k holds the cell k of count independent systems, one per lane, so the systems along the grid's rows are solved on transposed arrays. The eliminated diagonals only depend on the coefficients, so they are computed once per step.
+	// rhs = laplacian(u) * courant with the 5-point laplacian.
+	void (*laplacianRow)(Scalar* rhs, const T* const* u, const Scalar* courant, i64 count);
+	// The forward elimination for row k, rhs = rhs * inversePivot + lower * previousRhs. previousRhs points at row k - 1 or at zeros for the first row.
+	void (*tridiagonalEliminationRow)(Scalar* rhs, const Scalar* previousRhs, const Scalar* lower, const Scalar* inversePivot, i64 count);
+	// The back substitution for row k, rhs = rhs - upper * nextW. nextW points at row k + 1 or at zeros for the last row.
+	void (*tridiagonalSubstitutionRow)(Scalar* rhs, const Scalar* nextW, const Scalar* upper, i64 count);
+	// u_prev = u * uScale - u_prev * u_prevScale + w * courant * wScale. The next u is written over u_prev like in leapfrogRow.
+	void (*implicitUpdateRow)(T* u_prev, const T* u, const Scalar* w, const Scalar* courant, Scalar uScale, Scalar u_prevScale, Scalar wScale, i64 count);
+};
+
+struct WaveKernels {
+	InstructionSet instructionSet;
+
+	WaveStepKernels<f32> stepF32;
+	WaveStepKernels<F16> stepF16;
+	WaveStepKernels<BF16> stepBf16;
+	WaveStepKernels<f64> stepF64;
+
+	template<typename T>
+	const WaveStepKernels<T>& step() const;
+
+	// 3x3 gaussian blur of a row. below, row and above are read from the cell before the row to the cell after it, so they need ghost cells.
+	void (*blurRow)(f32* out, const f32* below, const f32* row, const f32* above, i64 count);
+	// Sets covered[i] to 1 if area0 + i * step0, area1 + i * step1 and area2 + i * step2 are all greater than 0 and to 0 otherwise. The areas are the signed areas of the triangles formed by a cell and the triangle edges.
+	void (*triangleCoverageRow)(u8* covered, f32 area0, f32 area1, f32 area2, f32 step0, f32 step1, f32 step2, i64 count);
+};
+
+extern const WaveKernels waveKernelsScalar;
+extern const WaveKernels waveKernelsSse4_2;
+extern const WaveKernels waveKernelsAvx2;
+extern const WaveKernels waveKernelsAvx512;
+
+const WaveKernels& waveKernelsFor(InstructionSet instructionSet);
+// Set to the best supported instruction set at startup. Can be changed to any supported instruction set.
+extern const WaveKernels* waveKernels;
+
+template<>
+inline const WaveStepKernels<f32>& WaveKernels::step<f32>() const {
+	return stepF32;
+}
+
+template<>
+inline const WaveStepKernels<F16>& WaveKernels::step<F16>() const {
+	return stepF16;
+}
+
+template<>
+inline const WaveStepKernels<BF16>& WaveKernels::step<BF16>() const {
+	return stepBf16;
+}
+
+template<>
+inline const WaveStepKernels<f64>& WaveKernels::step<f64>() const {
+	return stepF64;
+}
+
+template<typename T>
+inline void waveLeapfrogRow(T* u_prev, const T* const* u, const u8* material, const WaveComputeType<T>* coefficient, i64 materialCount, WaveComputeType<T> uScale, WaveComputeType<T> u_prevScale, WaveComputeType<T> laplacianScale, i64 count) {
+	waveKernels->step<T>().leapfrogRow(u_prev, u, material, coefficient, materialCount, uScale, u_prevScale, laplacianScale, count);
+}
+
+template<typename T>
+inline void waveSecondOrderLeapfrogRow(T* u_prev, const T* const* u, const u8* material, const WaveComputeType<T>* coefficient, i64 materialCount, WaveComputeType<T> uScale, WaveComputeType<T> u_prevScale, WaveComputeType<T> laplacianScale, i64 count) {
+	waveKernels->step<T>().secondOrderLeapfrogRow(u_prev, u, material, coefficient, materialCount, uScale, u_prevScale, laplacianScale, count);
+}
+
+template<typename T>
+inline void waveAbsorbingRow(T* uNext, const T* u, const T* uInside, const u8* material, const WaveComputeType<T>* coefficient, i64 materialCount, WaveComputeType<T> courantScale, WaveComputeType<T> scale, i64 count) {
+	waveKernels->step<T>().absorbingRow(uNext, u, uInside, material, coefficient, materialCount, courantScale, scale, count);
+}
+
+template<typename T>
+inline void wavePerfectlyMatchedLayerRow(T* u_prev, const T* const* u, const u8* material, const WaveComputeType<T>* coefficient, i64 materialCount, WaveComputeType<T>* memory, i64 memoryStride, const WaveComputeType<T>* decay, i64 decayStride, WaveComputeType<T> uScale, WaveComputeType<T> u_prevScale, WaveComputeType<T> laplacianScale, i64 count) {
+	waveKernels->step<T>().perfectlyMatchedLayerRow(u_prev, u, material, coefficient, materialCount, memory, memoryStride, decay, decayStride, uScale, u_prevScale, laplacianScale, count);
+}
+
+template<typename T>
+inline void waveDampingRow(T* uNext, const T* u, const u8* material, const WaveComputeType<T>* damping, i64 materialCount, WaveComputeType<T> uScale, i64 count) {
+	waveKernels->step<T>().dampingRow(uNext, u, material, damping, materialCount, uScale, count);
+}
+
+template<typename T>
+inline void waveLaplacianRow(WaveComputeType<T>* rhs, const T* const* u, const WaveComputeType<T>* courant, i64 count) {
+	waveKernels->step<T>().laplacianRow(rhs, u, courant, count);
+}
+
+template<typename T>
+inline void waveTridiagonalEliminationRow(WaveComputeType<T>* rhs, const WaveComputeType<T>* previousRhs, const WaveComputeType<T>* lower, const WaveComputeType<T>* inversePivot, i64 count) {
+	waveKernels->step<T>().tridiagonalEliminationRow(rhs, previousRhs, lower, inversePivot, count);
+}
+
+template<typename T>
+inline void waveTridiagonalSubstitutionRow(WaveComputeType<T>* rhs, const WaveComputeType<T>* nextW, const WaveComputeType<T>* upper, i64 count) {
+	waveKernels->step<T>().tridiagonalSubstitutionRow(rhs, nextW, upper, count);
+}
+
+template<typename T>
+inline void waveImplicitUpdateRow(T* u_prev, const T* u, const WaveComputeType<T>* w, const WaveComputeType<T>* courant, WaveComputeType<T> uScale, WaveComputeType<T> u_prevScale, WaveComputeType<T> wScale, i64 count) {
+	waveKernels->step<T>().implicitUpdateRow(u_prev, u, w, courant, uScale, u_prevScale, wScale, count);
+}
+
+inline void displayBlurRow(f32* out, const f32* below, const f32* row, const f32* above, i64 count) {
+	waveKernels->blurRow(out, below, row, above, count);
+}
+
+inline void rasterizeTriangleCoverageRow(u8* covered, f32 area0, f32 area1, f32 area2, f32 step0, f32 step1, f32 step2, i64 count) {
+	waveKernels->triangleCoverageRow(covered, area0, area1, area2, step0, step1, step2, count);
+}
+
+const char* waveKernelsInstructionSetName();
@@ -0,0 +1,3 @@
+#include <game/WaveKernelsImplementation.hpp>
+
+const WaveKernels waveKernelsAvx2 = makeWaveKernels(InstructionSet::AVX2);
@@ -0,0 +1,3 @@
+#include <game/WaveKernelsImplementation.hpp>
+
+const WaveKernels waveKernelsAvx512 = makeWaveKernels(InstructionSet::AVX512);
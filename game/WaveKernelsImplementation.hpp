@@ -0,0 +1,322 @@
+#pragma once
+
+// Included once by each of the WaveKernels<instruction set>.cpp files, which are compiled with different instruction sets enabled.
+
+#include <game/WaveKernels.hpp>
+#include <game/Simd.hpp>
+#include <game/WaveStencil.hpp>
+#include <array>
+#include <cmath>
+
+namespace {
+
+// The table entries of a vector of materials. The table usually fits in a vector, and then the entries are shuffled out of it instead of gathered.
+template<typename Vector>
+struct MaterialTable {
+	using Scalar = typename Vector::Scalar;
+
+	MaterialTable(const Scalar* values, i64 materialCount)
+		: values(values)
+		, shuffled(materialCount <= Vector::SHUFFLE_TABLE_SIZE) {
+		if (shuffled) {
+			valuesN = Vector::load(values);
+		}
+	}
+
+	Vector operator[](const u8* indices) const {
+		if constexpr (Vector::SHUFFLE_TABLE_SIZE != 0) {
+			if (shuffled) {
+				return Vector::shuffle(valuesN, indices);
+			}
+		}
+		return Vector::gather(values, indices);
+	}
+
+	const Scalar* values;
+	bool shuffled;
+	Vector valuesN{};
+};
+
+template<typename T, i32 order>
+void leapfrogRow(T* u_prev, const T* const* u, const u8* material, const WaveComputeType<T>* coefficient, i64 materialCount, WaveComputeType<T> uScale, WaveComputeType<T> u_prevScale, WaveComputeType<T> laplacianScale, i64 count) {
+	using Scalar = WaveComputeType<T>;
+	using Vector = SimdVector<Scalar>;
+	constexpr auto weights = waveStencilWeights<order>();
+	constexpr auto radius = i64(weights.size()) - 1;
+	// Both second derivatives weight the center.
+	const auto centerWeight = Scalar(2.0 * weights[0]);
+	const auto centerWeightN = Vector::broadcast(centerWeight);
+	std::array<Vector, radius + 1> weightsN;
+	for (i64 j = 1; j <= radius; j++) {
+		weightsN[j] = Vector::broadcast(Scalar(weights[j]));
+	}
+	const auto uScaleN = Vector::broadcast(uScale);
+	const auto minusU_prevScaleN = Vector::broadcast(-u_prevScale);
+	const auto laplacianScaleN = Vector::broadcast(laplacianScale);
+	const MaterialTable<Vector> coefficientN(coefficient, materialCount);
+
+	// The cells j apart in both directions share a weight, so they are summed first. The farthest ones have the smallest weights and are added first.
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		auto neighbourSum = [&](i64 j) {
+			return Vector::load(u[0] + i - j) + Vector::load(u[0] + i + j) + Vector::load(u[-j] + i) + Vector::load(u[j] + i);
+		};
+		const auto uN = Vector::load(u[0] + i);
+		auto laplacian = neighbourSum(radius);
+		if constexpr (order != 2) {
+			laplacian = laplacian * weightsN[radius];
+			for (i64 j = radius - 1; j >= 1; j--) {
+				laplacian = mulAdd(neighbourSum(j), weightsN[j], laplacian);
+			}
+		}
+		laplacian = mulAdd(uN, centerWeightN, laplacian);
+		const auto withoutLaplacian = mulAdd(uN, uScaleN, Vector::load(u_prev + i) * minusU_prevScaleN);
+		const auto result = mulAdd(laplacian, coefficientN[material + i] * laplacianScaleN, withoutLaplacian);
+		result.store(u_prev + i);
+	}
+
+	for (; i < count; i++) {
+		auto neighbourSum = [&](i64 j) {
+			return loadWaveValue(u[0][i - j]) + loadWaveValue(u[0][i + j]) + loadWaveValue(u[-j][i]) + loadWaveValue(u[j][i]);
+		};
+		const auto uI = loadWaveValue(u[0][i]);
+		auto laplacian = neighbourSum(radius);
+		if constexpr (order != 2) {
+			laplacian *= Scalar(weights[radius]);
+			for (i64 j = radius - 1; j >= 1; j--) {
+				laplacian += neighbourSum(j) * Scalar(weights[j]);
+			}
+		}
+		laplacian += centerWeight * uI;
+		u_prev[i] = storeWaveValue<T>(uI * uScale - loadWaveValue(u_prev[i]) * u_prevScale + laplacian * coefficient[material[i]] * laplacianScale);
+	}
+}
+
+template<typename T>
+void absorbingRow(T* uNext, const T* u, const T* uInside, const u8* material, const WaveComputeType<T>* coefficient, i64 materialCount, WaveComputeType<T> courantScale, WaveComputeType<T> scale, i64 count) {
+	using Vector = SimdVector<WaveComputeType<T>>;
+	const auto courantScaleN = Vector::broadcast(courantScale);
+	const auto scaleN = Vector::broadcast(scale);
+	const MaterialTable<Vector> coefficientN(coefficient, materialCount);
+
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		const auto uN = Vector::load(u + i);
+		const auto result = mulAdd(sqrt(coefficientN[material + i]) * courantScaleN, Vector::load(uInside + i) - uN, uN) * scaleN;
+		result.store(uNext + i);
+	}
+
+	for (; i < count; i++) {
+		const auto uI = loadWaveValue(u[i]);
+		uNext[i] = storeWaveValue<T>((uI + std::sqrt(coefficient[material[i]]) * courantScale * (loadWaveValue(uInside[i]) - uI)) * scale);
+	}
+}
+
+template<typename T>
+void perfectlyMatchedLayerRow(T* u_prev, const T* const* u, const u8* material, const WaveComputeType<T>* coefficient, i64 materialCount, WaveComputeType<T>* memory, i64 memoryStride, const WaveComputeType<T>* decay, i64 decayStride, WaveComputeType<T> uScale, WaveComputeType<T> u_prevScale, WaveComputeType<T> laplacianScale, i64 count) {
+	using Scalar = WaveComputeType<T>;
+	using Vector = SimdVector<Scalar>;
+	const auto uScaleN = Vector::broadcast(uScale);
+	const auto minusU_prevScaleN = Vector::broadcast(-u_prevScale);
+	const auto laplacianScaleN = Vector::broadcast(laplacianScale);
+	const MaterialTable<Vector> coefficientN(coefficient, materialCount);
+
+	// With stretched = decay * (memory + difference) the memory becomes stretched - difference.
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		auto stretch = [&](i64 k, Vector difference) {
+			const auto stretched = Vector::load(decay + k * decayStride + i) * (Vector::load(memory + k * memoryStride + i) + difference);
+			(stretched - difference).store(memory + k * memoryStride + i);
+			return stretched;
+		};
+		const auto uN = Vector::load(u[0] + i);
+		auto secondDerivative = [&](i64 k, Vector lower, Vector upper) {
+			const auto difference = stretch(k + 2, upper - uN) - stretch(k, uN - lower);
+			return stretch(k + 1, difference);
+		};
+		const auto laplacian = secondDerivative(0, Vector::load(u[0] + i - 1), Vector::load(u[0] + i + 1)) + secondDerivative(3, Vector::load(u[-1] + i), Vector::load(u[1] + i));
+		const auto withoutLaplacian = mulAdd(uN, uScaleN, Vector::load(u_prev + i) * minusU_prevScaleN);
+		mulAdd(laplacian, coefficientN[material + i] * laplacianScaleN, withoutLaplacian).store(u_prev + i);
+	}
+
+	for (; i < count; i++) {
+		auto stretch = [&](i64 k, Scalar difference) {
+			const auto stretched = decay[k * decayStride + i] * (memory[k * memoryStride + i] + difference);
+			memory[k * memoryStride + i] = stretched - difference;
+			return stretched;
+		};
+		const auto uI = loadWaveValue(u[0][i]);
+		auto secondDerivative = [&](i64 k, Scalar lower, Scalar upper) {
+			const auto difference = stretch(k + 2, upper - uI) - stretch(k, uI - lower);
+			return stretch(k + 1, difference);
+		};
+		const auto laplacian = secondDerivative(0, loadWaveValue(u[0][i - 1]), loadWaveValue(u[0][i + 1])) + secondDerivative(3, loadWaveValue(u[-1][i]), loadWaveValue(u[1][i]));
+		u_prev[i] = storeWaveValue<T>(uI * uScale - loadWaveValue(u_prev[i]) * u_prevScale + laplacian * coefficient[material[i]] * laplacianScale);
+	}
+}
+
+template<typename T>
+void dampingRow(T* uNext, const T* u, const u8* material, const WaveComputeType<T>* damping, i64 materialCount, WaveComputeType<T> uScale, i64 count) {
+	using Vector = SimdVector<WaveComputeType<T>>;
+	const auto uScaleN = Vector::broadcast(uScale);
+	const MaterialTable<Vector> dampingN(damping, materialCount);
+
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		const auto uNextN = Vector::load(uNext + i);
+		mulAdd(dampingN[material + i], Vector::load(u + i) * uScaleN - uNextN, uNextN).store(uNext + i);
+	}
+
+	for (; i < count; i++) {
+		const auto uNextI = loadWaveValue(uNext[i]);
+		uNext[i] = storeWaveValue<T>(uNextI - damping[material[i]] * (uNextI - loadWaveValue(u[i]) * uScale));
+	}
+}
+
+template<typename T>
+void laplacianRow(WaveComputeType<T>* rhs, const T* const* u, const WaveComputeType<T>* courant, i64 count) {
+	using Scalar = WaveComputeType<T>;
+	using Vector = SimdVector<Scalar>;
+	const auto minusFourN = Vector::broadcast(Scalar(-4));
+
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		const auto neighbourSum = Vector::load(u[0] + i - 1) + Vector::load(u[0] + i + 1) + Vector::load(u[-1] + i) + Vector::load(u[1] + i);
+		const auto laplacian = mulAdd(Vector::load(u[0] + i), minusFourN, neighbourSum);
+		(laplacian * Vector::load(courant + i)).store(rhs + i);
+	}
+
+	for (; i < count; i++) {
+		const auto neighbourSum = loadWaveValue(u[0][i - 1]) + loadWaveValue(u[0][i + 1]) + loadWaveValue(u[-1][i]) + loadWaveValue(u[1][i]);
+		rhs[i] = (neighbourSum - Scalar(4) * loadWaveValue(u[0][i])) * courant[i];
+	}
+}
+
+template<typename Scalar>
+void tridiagonalEliminationRow(Scalar* rhs, const Scalar* previousRhs, const Scalar* lower, const Scalar* inversePivot, i64 count) {
+	using Vector = SimdVector<Scalar>;
+
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		mulAdd(Vector::load(previousRhs + i), Vector::load(lower + i), Vector::load(rhs + i) * Vector::load(inversePivot + i)).store(rhs + i);
+	}
+
+	for (; i < count; i++) {
+		rhs[i] = rhs[i] * inversePivot[i] + lower[i] * previousRhs[i];
+	}
+}
+
+template<typename Scalar>
+void tridiagonalSubstitutionRow(Scalar* rhs, const Scalar* nextW, const Scalar* upper, i64 count) {
+	using Vector = SimdVector<Scalar>;
+
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		(Vector::load(rhs + i) - Vector::load(nextW + i) * Vector::load(upper + i)).store(rhs + i);
+	}
+
+	for (; i < count; i++) {
+		rhs[i] -= upper[i] * nextW[i];
+	}
+}
+
+template<typename T>
+void implicitUpdateRow(T* u_prev, const T* u, const WaveComputeType<T>* w, const WaveComputeType<T>* courant, WaveComputeType<T> uScale, WaveComputeType<T> u_prevScale, WaveComputeType<T> wScale, i64 count) {
+	using Vector = SimdVector<WaveComputeType<T>>;
+	const auto uScaleN = Vector::broadcast(uScale);
+	const auto minusU_prevScaleN = Vector::broadcast(-u_prevScale);
+	const auto wScaleN = Vector::broadcast(wScale);
+
+	i64 i = 0;
+	for (; i + Vector::LANES <= count; i += Vector::LANES) {
+		const auto withoutW = mulAdd(Vector::load(u + i), uScaleN, Vector::load(u_prev + i) * minusU_prevScaleN);
+		mulAdd(Vector::load(w + i) * Vector::load(courant + i), wScaleN, withoutW).store(u_prev + i);
+	}
+
+	for (; i < count; i++) {
+		u_prev[i] = storeWaveValue<T>(loadWaveValue(u[i]) * uScale - loadWaveValue(u_prev[i]) * u_prevScale + w[i] * courant[i] * wScale);
+	}
+}
+
+void blurRow(f32* out, const f32* below, const f32* row, const f32* above, i64 count) {
+	// The kernel is separable. Sum the rows with weights 1 2 1 and then the columns with weights 1 2 1.
+	auto columnSum = [&](i64 x) {
+		return below[x] + 2.0f * row[x] + above[x];
+	};
+	const auto two = F32xN::broadcast(2.0f);
+	const auto scale = F32xN::broadcast(1.0f / 16.0f);
+	auto columnSumN = [&](i64 x) {
+		return mulAdd(F32xN::load(row + x), two, F32xN::load(below + x) + F32xN::load(above + x));
+	};
+
+	i64 x = 0;
+	for (; x + F32xN::LANES <= count; x += F32xN::LANES) {
+		const auto result = mulAdd(columnSumN(x), two, columnSumN(x - 1) + columnSumN(x + 1)) * scale;
+		result.store(out + x);
+	}
+	for (; x < count; x++) {
+		out[x] = (columnSum(x - 1) + 2.0f * columnSum(x) + columnSum(x + 1)) * (1.0f / 16.0f);
+	}
+}
+
+void triangleCoverageRow(u8* covered, f32 area0, f32 area1, f32 area2, f32 step0, f32 step1, f32 step2, i64 count) {
+	i64 i = 0;
+	if constexpr (F32xN::LANES > 1) {
+		f32 laneIndices[F32xN::LANES];
+		for (i64 lane = 0; lane < F32xN::LANES; lane++) {
+			laneIndices[lane] = f32(lane);
+		}
+		const auto laneIndicesN = F32xN::load(laneIndices);
+		const auto area0N = F32xN::broadcast(area0);
+		const auto area1N = F32xN::broadcast(area1);
+		const auto area2N = F32xN::broadcast(area2);
+		const auto step0N = F32xN::broadcast(step0);
+		const auto step1N = F32xN::broadcast(step1);
+		const auto step2N = F32xN::broadcast(step2);
+
+		for (; i + F32xN::LANES <= count; i += F32xN::LANES) {
+			const auto indices = F32xN::broadcast(f32(i)) + laneIndicesN;
+			const auto mask =
+				positiveLanesMask(mulAdd(indices, step0N, area0N)) &
+				positiveLanesMask(mulAdd(indices, step1N, area1N)) &
+				positiveLanesMask(mulAdd(indices, step2N, area2N));
+			for (i64 lane = 0; lane < F32xN::LANES; lane++) {
+				covered[i + lane] = (mask >> lane) & 1;
+			}
+		}
+	}
+
+	for (; i < count; i++) {
+		const auto index = f32(i);
+		covered[i] = area0 + index * step0 > 0.0f && area1 + index * step1 > 0.0f && area2 + index * step2 > 0.0f;
+	}
+}
+
+template<typename T>
+constexpr WaveStepKernels<T> makeWaveStepKernels() {
+	return WaveStepKernels<T>{
+		.leapfrogRow = leapfrogRow<T, WAVE_STENCIL_ORDER>,
+		.secondOrderLeapfrogRow = leapfrogRow<T, 2>,
+		.absorbingRow = absorbingRow<T>,
+		.perfectlyMatchedLayerRow = perfectlyMatchedLayerRow<T>,
+		.dampingRow = dampingRow<T>,
+		.laplacianRow = laplacianRow<T>,
+		.tridiagonalEliminationRow = tridiagonalEliminationRow<WaveComputeType<T>>,
+		.tridiagonalSubstitutionRow = tridiagonalSubstitutionRow<WaveComputeType<T>>,
+		.implicitUpdateRow = implicitUpdateRow<T>,
+	};
+}
+
+constexpr WaveKernels makeWaveKernels(InstructionSet instructionSet) {
+	return WaveKernels{
+		.instructionSet = instructionSet,
+		.stepF32 = makeWaveStepKernels<f32>(),
+		.stepF16 = makeWaveStepKernels<F16>(),
+		.stepBf16 = makeWaveStepKernels<BF16>(),
+		.stepF64 = makeWaveStepKernels<f64>(),
+		.blurRow = blurRow,
+		.triangleCoverageRow = triangleCoverageRow,
+	};
+}
+
+}
@@ -0,0 +1,4 @@
+#define SIMD_SCALAR
+#include <game/WaveKernelsImplementation.hpp>
+
+const WaveKernels waveKernelsScalar = makeWaveKernels(InstructionSet::SCALAR);
@@ -0,0 +1,3 @@
+#include <game/WaveKernelsImplementation.hpp>
+
+const WaveKernels waveKernelsSse4_2 = makeWaveKernels(InstructionSet::SSE4_2);
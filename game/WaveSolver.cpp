@@ -0,0 +1,1683 @@
+#include <game/WaveSolver.hpp>
+#include <game/WaveKernels.hpp>
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+void WaveWallSpans::clear(i64 sizeY) {
+	spans.clear();
+	rowOffsets.assign(sizeY + 1, 0);
+	added.clear();
+}
+
+void WaveWallSpans::add(i64 y, i64 begin, i64 end) {
+	if (begin < end && y >= 0 && y + 1 < i64(rowOffsets.size())) {
+		added.push_back(RowSpan{ .y = y, .span = Span{ .begin = begin, .end = end } });
+	}
+}
+
+void WaveWallSpans::merge() {
+	std::sort(added.begin(), added.end(), [](const RowSpan& a, const RowSpan& b) {
+		return a.y != b.y ? a.y < b.y : a.span.begin < b.span.begin;
+	});
+	spans.clear();
+	const auto sizeY = i64(rowOffsets.size()) - 1;
+	auto rowSpan = added.begin();
+	for (i64 y = 0; y < sizeY; y++) {
+		rowOffsets[y] = i64(spans.size());
+		for (; rowSpan != added.end() && rowSpan->y == y; rowSpan++) {
+			const auto rowHasSpans = i64(spans.size()) > rowOffsets[y];
+			if (rowHasSpans && spans.back().end >= rowSpan->span.begin) {
+				spans.back().end = std::max(spans.back().end, rowSpan->span.end);
+			} else {
+				spans.push_back(rowSpan->span);
+			}
+		}
+	}
+	rowOffsets[sizeY] = i64(spans.size());
+	added.clear();
+}
+
+bool WaveWallSpans::isWall(i64 x, i64 y) const {
+	const auto rowEnd = spans.begin() + rowOffsets[y + 1];
+	const auto span = std::upper_bound(spans.begin() + rowOffsets[y], rowEnd, x, [](i64 x, const Span& span) {
+		return x < span.end;
+	});
+	return span != rowEnd && span->begin <= x;
+}
+
+// The rows [rowBegin, rowEnd) of the grid belong to the band. The rows in [rowBegin - haloSize, rowBegin) and [rowEnd, rowEnd + haloSize) that lie inside the grid are read from the halo copies, except for the edge rows of the grid next to the band, which are used in place. Without a halo all the rows are used in place.
+// Buffer 0 is u and buffer 1 is u_prev. Substep s of the step reads u from buffer s % 2 and writes the next u to the other one.
+struct WaveSolver::Band {
+	const WaveSolver& solver;
+	WaveField& field;
+	const WaveStepParameters& p;
+	i64 rowBegin;
+	i64 rowEnd;
+	i64 haloSize;
+	WaveSolver::BandHalo* halo;
+	// The index of the block's first substep in the step.
+	i64 firstSubstep;
+	// Only updates the cells of a time step level if set.
+	const WaveSolver::LevelSpans* levelSpans = nullptr;
+	// How many times longer the substeps are than the ones the coefficients were computed for, 2^l for the level l.
+	f32 substepRatio = 1.0f;
+	// How many substeps ago u_prev is from. The velocity (u - u_prev) / u_prevAge is kept.
+	f32 u_prevAge = 1.0f;
+	// With the tiles layout the band is the rows of the tile (tileX, tileY) and only updates its columns [columnBegin, columnBegin + WAVE_FIELD_TILE_SIZE). The row pointers point at the cell columnBegin, which is 0 with the rows layout.
+	i64 tileX = -1;
+	i64 tileY = -1;
+	i64 columnBegin = 0;
+	// Every row of the band is a single span updated by the high order leapfrog.
+	bool uniform = false;
+
+	bool isInGrid(i64 y) const {
+		return (y >= rowBegin && y < rowEnd) || (y == 0 && rowBegin == 1) || (y == field.sizeY - 1 && rowEnd == field.sizeY - 1);
+	}
+
+	// The index of the cell (columnBegin, y) in the field's arrays.
+	i64 rowIndex(i64 y) const {
+		if (tileX == -1) {
+			return y * field.pitch;
+		}
+		return field.tileOrigin(tileX, tileY) + (y - tileY * WAVE_FIELD_TILE_SIZE) * field.tilePitch;
+	}
+
+	template<typename T>
+	T* row(i64 buffer, i64 y) const {
+		if (halo == nullptr || isInGrid(y)) {
+			return WaveField::elements<T>(buffer == 0 ? field.uBytes : field.u_prevBytes) + rowIndex(y);
+		}
+		if (y < rowBegin) {
+			return WaveField::elements<T>(halo->below[buffer]) + (y - (rowBegin - haloSize)) * field.pitch;
+		}
+		return WaveField::elements<T>(halo->above[buffer]) + (y - rowEnd) * field.pitch;
+	}
+
+	template<typename T>
+	void copyHalo() const {
+		auto copyRow = [&](i64 y) {
+			if (!isInGrid(y)) {
+				std::copy_n(WaveField::elements<T>(field.uBytes) + y * field.pitch, field.sizeX, row<T>(0, y));
+				std::copy_n(WaveField::elements<T>(field.u_prevBytes) + y * field.pitch, field.sizeX, row<T>(1, y));
+			}
+		};
+		for (i64 y = std::max(rowBegin - haloSize, i64(0)); y < rowBegin; y++) {
+			copyRow(y);
+		}
+		for (i64 y = rowEnd; y < std::min(rowEnd + haloSize, field.sizeY); y++) {
+			copyRow(y);
+		}
+
+		if (solver.layerCellCount == 0) {
+			return;
+		}
+		using Scalar = WaveComputeType<T>;
+		const auto memory = WaveField::elements<Scalar>(field.layerMemoryBytes);
+		for (const auto below : { true, false }) {
+			const auto [firstRow, endRow] = layerHaloRows(below);
+			const auto firstCell = solver.layerRowCells[firstRow];
+			const auto cellCount = solver.layerRowCells[endRow] - firstCell;
+			auto& copy = below ? halo->layerBelow : halo->layerAbove;
+			copy.resize(LAYER_MEMORY_ARRAY_COUNT * cellCount * sizeof(Scalar));
+			for (i64 array = 0; array < LAYER_MEMORY_ARRAY_COUNT; array++) {
+				std::copy_n(memory + array * solver.layerCellCount + firstCell, cellCount, WaveField::elements<Scalar>(copy) + array * cellCount);
+			}
+		}
+	}
+
+	// The rows whose layer memory is in halo->layerBelow or halo->layerAbove.
+	std::pair<i64, i64> layerHaloRows(bool below) const {
+		if (below) {
+			return { std::max(rowBegin - haloSize, i64(0)), rowBegin };
+		}
+		return { rowEnd, std::min(rowEnd + haloSize, field.sizeY) };
+	}
+
+	// The memory of the layer cell with the given number, which is in row y, and the distance between its arrays.
+	template<typename Scalar>
+	std::pair<Scalar*, i64> layerMemory(i64 y, i64 cell) const {
+		if (halo == nullptr || isInGrid(y)) {
+			return { WaveField::elements<Scalar>(field.layerMemoryBytes) + cell, solver.layerCellCount };
+		}
+		const auto below = y < rowBegin;
+		const auto [firstRow, endRow] = layerHaloRows(below);
+		const auto firstCell = solver.layerRowCells[firstRow];
+		return { WaveField::elements<Scalar>(below ? halo->layerBelow : halo->layerAbove) + (cell - firstCell), solver.layerRowCells[endRow] - firstCell };
+	}
+
+	// Substep s of a block of depth d updates the rows [rowBegin - (d - 1 - s) * r, rowEnd + (d - 1 - s) * r) clamped to the interior, where r is the stencil radius. After the last substep only the band is valid.
+	i64 substepRowBegin(i64 substep, i64 depth) const {
+		return std::max(rowBegin - (depth - 1 - substep) * WAVE_STENCIL_RADIUS, i64(1));
+	}
+
+	i64 substepRowEnd(i64 substep, i64 depth) const {
+		return std::min(rowEnd + (depth - 1 - substep) * WAVE_STENCIL_RADIUS, field.sizeY - 1);
+	}
+
+	// Calls function(begin, end) for the parts of [begin, end) of row y between the walls.
+	template<typename Function>
+	void forEachSpanBetweenWalls(i64 y, i64 begin, i64 end, Function function) const {
+		const auto& walls = solver.walls;
+		if (i64(walls.rowOffsets.size()) <= y + 1) {
+			function(begin, end);
+			return;
+		}
+		const auto rowEnd = walls.spans.begin() + walls.rowOffsets[y + 1];
+		auto wall = std::upper_bound(walls.spans.begin() + walls.rowOffsets[y], rowEnd, begin, [](i64 x, const WaveWallSpans::Span& span) {
+			return x < span.end;
+		});
+		for (; wall != rowEnd && wall->begin < end; wall++) {
+			if (begin < wall->begin) {
+				function(begin, wall->begin);
+			}
+			begin = wall->end;
+		}
+		if (begin < end) {
+			function(begin, end);
+		}
+	}
+
+	// Calls function(begin, end) for each span of updated cells in row y.
+	template<typename Function>
+	void forEachSpan(i64 y, Function function) const {
+		if (levelSpans != nullptr) {
+			for (i64 i = levelSpans->cellsOffsets[y]; i < levelSpans->cellsOffsets[y + 1]; i++) {
+				forEachSpanBetweenWalls(y, levelSpans->cells[i].begin, levelSpans->cells[i].end, function);
+			}
+			return;
+		}
+		const auto spansY = y / solver.tileSize;
+		for (i64 i = solver.tileRowSpansOffsets[spansY]; i < solver.tileRowSpansOffsets[spansY + 1]; i++) {
+			if (tileX == -1) {
+				forEachSpanBetweenWalls(y, solver.tileRowSpans[i].begin, solver.tileRowSpans[i].end, function);
+				continue;
+			}
+			const auto begin = std::max(solver.tileRowSpans[i].begin, columnBegin);
+			const auto end = std::min(solver.tileRowSpans[i].end, columnBegin + WAVE_FIELD_TILE_SIZE);
+			if (begin < end) {
+				forEachSpanBetweenWalls(y, begin, end, function);
+			}
+		}
+	}
+
+	// Splits the spans of row y further and calls function(begin, end, highOrder). highOrder is false where the stencil would read the edges of the grid, which aren't integrated, or read through a wall.
+	template<typename Function>
+	void forEachStencilSpan(i64 y, Function function) const {
+		const auto r = WAVE_STENCIL_RADIUS;
+		if (r == 1 || y <= r || y >= field.sizeY - 1 - r) {
+			forEachSpan(y, [&](i64 begin, i64 end) {
+				function(begin, end, r == 1);
+			});
+			return;
+		}
+
+		const auto hasLowOrderSpans = i64(solver.lowOrderSpansOffsets.size()) == field.sizeY + 1;
+		auto lowOrder = hasLowOrderSpans ? solver.lowOrderSpans.begin() + solver.lowOrderSpansOffsets[y] : solver.lowOrderSpans.end();
+		const auto lowOrderEnd = hasLowOrderSpans ? solver.lowOrderSpans.begin() + solver.lowOrderSpansOffsets[y + 1] : solver.lowOrderSpans.end();
+		const auto highOrderEnd = field.sizeX - 1 - r;
+		forEachSpan(y, [&](i64 begin, i64 end) {
+			auto x = begin;
+			auto callUntil = [&](i64 spanEnd, bool highOrder) {
+				spanEnd = std::min(spanEnd, end);
+				if (x < spanEnd) {
+					function(x, spanEnd, highOrder);
+					x = spanEnd;
+				}
+			};
+			callUntil(r + 1, false);
+			// The low order spans are sorted, so the ones before this span are never needed again. A span that continues past the end can overlap the next span.
+			for (; lowOrder != lowOrderEnd && lowOrder->begin < end; lowOrder++) {
+				callUntil(std::min(lowOrder->begin, highOrderEnd), true);
+				callUntil(lowOrder->end, false);
+				if (lowOrder->end > end) {
+					break;
+				}
+			}
+			callUntil(highOrderEnd, true);
+			callUntil(end, false);
+		});
+	}
+
+	template<typename T, WaveBoundaryConditions conditions>
+	void advance(i64 yi, i64 substep) const;
+
+	template<typename T, WaveBoundaryConditions conditions>
+	static void sweep(const Band& band, i64 depth);
+};
+
+// Damps the cells of row y in [begin, end). The pointers point at the cell begin.
+template<typename T>
+static void dampRow(const WaveSolver& solver, T* next, const T* u, const u8* material, const WaveComputeType<T>* damping, i64 materialCount, WaveComputeType<T> uScale, i64 y, i64 begin, i64 end) {
+	if (i64(solver.dampingSpansOffsets.size()) <= y + 1) {
+		return;
+	}
+	for (i64 spanIndex = solver.dampingSpansOffsets[y]; spanIndex < solver.dampingSpansOffsets[y + 1]; spanIndex++) {
+		const auto spanBegin = std::max(solver.dampingSpans[spanIndex].begin, begin);
+		const auto spanEnd = std::min(solver.dampingSpans[spanIndex].end, end);
+		if (spanBegin < spanEnd) {
+			const auto offset = spanBegin - begin;
+			waveDampingRow<T>(next + offset, u + offset, material + offset, damping, materialCount, uScale, spanEnd - spanBegin);
+		}
+	}
+}
+
+template<typename T, WaveBoundaryConditions conditions>
+void WaveSolver::Band::advance(i64 yi, i64 substep) const {
+	const auto sizeX = field.sizeX;
+	const auto current = (firstSubstep + substep) % 2;
+
+	// rows[r + dy] is row yi + dy. The rows outside of the grid are only read by the high order stencil, which isn't used in the rows near the edges.
+	const auto r = WAVE_STENCIL_RADIUS;
+	std::array<const T*, 2 * r + 1> rows;
+	for (i64 dy = -r; dy <= r; dy++) {
+		rows[r + dy] = row<T>(current, std::clamp(yi + dy, i64(0), field.sizeY - 1));
+	}
+	const auto below = rows[r - 1];
+	const auto above = rows[r + 1];
+	const auto u = rows[r];
+	const auto next = row<T>(1 - current, yi);
+	using Scalar = WaveComputeType<T>;
+	const auto material = field.materials.data() + rowIndex(yi);
+	const auto coefficient = WaveField::elements<Scalar>(field.coefficientTableBytes);
+	const auto damping = WaveField::elements<Scalar>(field.dampingTableBytes);
+	// u_prev from one substep ago would be u - (u - u_prev) / u_prevAge.
+	const auto u_prevWeight = Scalar(1) / Scalar(u_prevAge);
+	const auto dampedU_prevScale = Scalar(p.uDampingScale) * p.u_tDampingScale;
+	const auto uScale = Scalar(p.uDampingScale) + p.u_tDampingScale - dampedU_prevScale * (Scalar(1) - u_prevWeight);
+	const auto u_prevScale = dampedU_prevScale * u_prevWeight;
+	const auto scale = Scalar(p.uDampingScale);
+	const auto laplacianScale = scale * substepRatio * substepRatio;
+	const auto courantScale = Scalar(substepRatio);
+
+	// The offset of the cell x from the row pointers.
+	auto at = [&](i64 x) {
+		return x - columnBegin;
+	};
+
+	auto leapfrog = [&](i64 begin, i64 end, bool highOrder) {
+		if (begin >= end) {
+			return;
+		}
+		const auto count = end - begin;
+		std::array<const T*, 2 * r + 1> spanRows;
+		for (i64 i = 0; i < 2 * r + 1; i++) {
+			spanRows[i] = rows[i] + at(begin);
+		}
+		if (highOrder) {
+			waveLeapfrogRow(next + at(begin), spanRows.data() + r, material + at(begin), coefficient, field.materialCount, uScale, u_prevScale, laplacianScale, count);
+		} else {
+			waveSecondOrderLeapfrogRow(next + at(begin), spanRows.data() + r, material + at(begin), coefficient, field.materialCount, uScale, u_prevScale, laplacianScale, count);
+		}
+	};
+
+	if (uniform) {
+		leapfrog(columnBegin, columnBegin + WAVE_FIELD_TILE_SIZE, true);
+		return;
+	}
+
+	forEachStencilSpan(yi, [&](i64 begin, i64 end, bool highOrder) {
+		const auto count = end - begin;
+		// The layer cells can't be computed by leapfrogRow first, because it overwrites u_prev.
+		auto x = begin;
+		for (i64 spanIndex = solver.layerSpansOffsets[yi]; spanIndex < solver.layerSpansOffsets[yi + 1]; spanIndex++) {
+			const auto& layerSpan = solver.layerSpans[spanIndex];
+			const auto layerBegin = std::max(layerSpan.begin, begin);
+			const auto layerEnd = std::min(layerSpan.end, end);
+			if (layerBegin >= layerEnd) {
+				continue;
+			}
+			leapfrog(x, layerBegin, highOrder);
+			const auto cell = layerSpan.firstCell + layerBegin - layerSpan.begin;
+			const auto [memory, memoryStride] = layerMemory<Scalar>(yi, cell);
+			const T* const layerRows[]{ below + at(layerBegin), u + at(layerBegin), above + at(layerBegin) };
+			const auto decay = WaveField::elements<Scalar>(solver.layerDecay) + cell;
+			wavePerfectlyMatchedLayerRow<T>(next + at(layerBegin), layerRows + 1, material + at(layerBegin), coefficient, field.materialCount, memory, memoryStride, decay, solver.layerCellCount, uScale, u_prevScale, laplacianScale, layerEnd - layerBegin);
+			x = layerEnd;
+		}
+		leapfrog(x, end, highOrder);
+
+		if constexpr (conditions.bottomAbsorbing) {
+			if (yi == 1) {
+				waveAbsorbingRow(next + at(begin), u + at(begin), above + at(begin), material + at(begin), coefficient, field.materialCount, courantScale, scale, count);
+			}
+		}
+		if constexpr (conditions.topAbsorbing) {
+			if (yi == field.sizeY - 2) {
+				waveAbsorbingRow(next + at(begin), u + at(begin), below + at(begin), material + at(begin), coefficient, field.materialCount, courantScale, scale, count);
+			}
+		}
+		if constexpr (conditions.leftAbsorbing) {
+			if (begin == 1) {
+				waveAbsorbingRow(next + at(1), u + at(1), u + at(2), material + at(1), coefficient, field.materialCount, courantScale, scale, 1);
+			}
+		}
+		if constexpr (conditions.rightAbsorbing) {
+			if (end == sizeX - 1) {
+				waveAbsorbingRow(next + at(sizeX - 2), u + at(sizeX - 2), u + at(sizeX - 3), material + at(sizeX - 2), coefficient, field.materialCount, courantScale, scale, 1);
+			}
+		}
+		dampRow(solver, next + at(begin), u + at(begin), material + at(begin), damping, field.materialCount, scale, yi, begin, end);
+	});
+}
+
+template<typename T, WaveBoundaryConditions conditions>
+void WaveSolver::Band::sweep(const Band& band, i64 depth) {
+	// Substep s can compute row y once substep s - 1 has computed row y + r, where r is the stencil radius. After that substep s - 1 no longer reads row y of the buffer substep s writes to.
+	const auto r = WAVE_STENCIL_RADIUS;
+	const auto frontBegin = band.substepRowBegin(0, depth);
+	const auto frontEnd = band.substepRowEnd(depth - 1, depth) + (depth - 1) * r;
+	for (i64 front = frontBegin; front < frontEnd; front++) {
+		for (i64 substep = 0; substep < depth; substep++) {
+			const auto yi = front - substep * r;
+			if (yi >= band.substepRowBegin(substep, depth) && yi < band.substepRowEnd(substep, depth)) {
+				band.advance<T, conditions>(yi, substep);
+			}
+		}
+	}
+}
+
+static constexpr WaveBoundaryConditions boundaryConditionsFromIndex(i32 index) {
+	return WaveBoundaryConditions{
+		.topAbsorbing = (index & 0b0001) != 0,
+		.bottomAbsorbing = (index & 0b0010) != 0,
+		.leftAbsorbing = (index & 0b0100) != 0,
+		.rightAbsorbing = (index & 0b1000) != 0,
+	};
+}
+
+static i32 boundaryConditionsIndex(const WaveBoundaryConditions& conditions) {
+	return i32(conditions.topAbsorbing) | (i32(conditions.bottomAbsorbing) << 1) | (i32(conditions.leftAbsorbing) << 2) | (i32(conditions.rightAbsorbing) << 3);
+}
+
+template<typename T, i32... indices>
+static constexpr std::array<WaveSolver::BandSweepFunction, sizeof...(indices)> makeBandSweepTable(std::integer_sequence<i32, indices...>) {
+	return { &WaveSolver::Band::sweep<T, boundaryConditionsFromIndex(indices)>... };
+}
+
+// Indexed by the storage format and then by the boundary conditions.
+static constexpr std::array<std::array<WaveSolver::BandSweepFunction, 16>, 4> bandSweepTable{
+	makeBandSweepTable<f32>(std::make_integer_sequence<i32, 16>()),
+	makeBandSweepTable<F16>(std::make_integer_sequence<i32, 16>()),
+	makeBandSweepTable<BF16>(std::make_integer_sequence<i32, 16>()),
+	makeBandSweepTable<f64>(std::make_integer_sequence<i32, 16>()),
+};
+
+WaveSolver::WaveSolver() {
+	setBoundaryConditions(WaveBoundaryConditions{
+		.topAbsorbing = false,
+		.bottomAbsorbing = false,
+		.leftAbsorbing = false,
+		.rightAbsorbing = false,
+	});
+}
+
+void WaveSolver::setBoundaryConditions(const WaveBoundaryConditions& conditions) {
+	if (conditions != boundaryConditions) {
+		implicitEliminationOutdated = true;
+		layerSpansOutdated = true;
+	}
+	boundaryConditions = conditions;
+	for (i64 format = 0; format < i64(bandSweeps.size()); format++) {
+		bandSweeps[format] = bandSweepTable[format][boundaryConditionsIndex(conditions)];
+	}
+}
+
+void WaveSolver::setPerfectlyMatchedLayers(const WavePerfectlyMatchedLayers& layers) {
+	if (layers != perfectlyMatchedLayers) {
+		layerSpansOutdated = true;
+	}
+	perfectlyMatchedLayers = layers;
+}
+
+void WaveSolver::updatePerfectlyMatchedLayers(WaveField& field) {
+	const auto sizeX = field.sizeX;
+	const auto sizeY = field.sizeY;
+	const auto& layers = perfectlyMatchedLayers;
+	const auto thickness = layers.thickness;
+	if (i64(layerSpansOffsets.size()) != sizeY + 1 || layerSpansSizeX != sizeX) {
+		layerSpansOutdated = true;
+	}
+
+	const auto spansChanged = layerSpansOutdated;
+	if (layerSpansOutdated) {
+		layerSpansOutdated = false;
+		layerDecayOutdated = true;
+		layerSpansSizeX = sizeX;
+		layerSpans.clear();
+		layerSpansOffsets.assign(1, 0);
+		layerRowCells.assign(1, 0);
+		layerCellCount = 0;
+		// The cells next to the absorbing edges are set by absorbingRow.
+		const auto xBegin = i64(boundaryConditions.leftAbsorbing ? 2 : 1);
+		const auto xEnd = sizeX - (boundaryConditions.rightAbsorbing ? 2 : 1);
+		const auto yBegin = i64(boundaryConditions.bottomAbsorbing ? 2 : 1);
+		const auto yEnd = sizeY - (boundaryConditions.topAbsorbing ? 2 : 1);
+		auto addSpan = [&](i64 begin, i64 end) {
+			if (begin < end) {
+				layerSpans.push_back(LayerSpan{ .begin = begin, .end = end, .firstCell = layerCellCount });
+				layerCellCount += end - begin;
+			}
+		};
+		for (i64 y = 0; y < sizeY; y++) {
+			if (thickness > 0 && y >= yBegin && y < yEnd) {
+				const auto isInRowLayer = (layers.bottom && y < 1 + thickness) || (layers.top && y >= sizeY - 1 - thickness);
+				const auto leftEnd = isInRowLayer ? xEnd : layers.left ? std::min(1 + thickness, xEnd) : xBegin;
+				const auto rightBegin = layers.right ? std::max(sizeX - 1 - thickness, leftEnd) : xEnd;
+				if (leftEnd == rightBegin) {
+					addSpan(xBegin, xEnd);
+				} else {
+					addSpan(xBegin, leftEnd);
+					addSpan(rightBegin, xEnd);
+				}
+			}
+			layerSpansOffsets.push_back(layerSpans.size());
+			layerRowCells.push_back(layerCellCount);
+		}
+	}
+
+	const auto scalarSize = withWaveStorageType(field.format, []<typename T>(T) {
+		return i64(sizeof(WaveComputeType<T>));
+	});
+	const auto memoryBytes = LAYER_MEMORY_ARRAY_COUNT * layerCellCount * scalarSize;
+	if (spansChanged || i64(field.layerMemoryBytes.size()) != memoryBytes || i64(layerDecay.size()) != memoryBytes) {
+		field.layerMemoryBytes.assign(memoryBytes, 0);
+		layerDecayOutdated = true;
+	}
+	if (!layerDecayOutdated) {
+		return;
+	}
+	layerDecayOutdated = false;
+	layerDecay.resize(memoryBytes);
+
+	// How deep into the layers a point at x or y is, from 0 on the inner side to 1 on the edge.
+	auto depth = [&](f64 position, i64 size, bool lowLayer, bool highLayer) {
+		const auto t = std::max(
+			lowLayer ? (f64(thickness) + 0.5 - position) / f64(thickness) : 0.0,
+			highLayer ? (position - (f64(size - 1 - thickness) - 0.5)) / f64(thickness) : 0.0);
+		return std::clamp(t, 0.0, 1.0);
+	};
+	withWaveStorageType(field.format, [&]<typename T>(T) {
+		using Scalar = WaveComputeType<T>;
+		const auto coefficient = WaveField::elements<Scalar>(field.coefficientTableBytes);
+		const auto decay = WaveField::elements<Scalar>(layerDecay);
+		for (i64 y = 0; y < sizeY; y++) {
+			for (i64 spanIndex = layerSpansOffsets[y]; spanIndex < layerSpansOffsets[y + 1]; spanIndex++) {
+				const auto& span = layerSpans[spanIndex];
+				for (i64 x = span.begin; x < span.end; x++) {
+					const auto cell = span.firstCell + x - span.begin;
+					// damping * dt at the edge, where damping = (power + 1) * speed * ln(1 / reflection) / (2 * thickness * cellSize).
+					const auto courantNumber = std::sqrt(f64(coefficient[field.materialAt(x, y)]));
+					const auto maxDampingDt = (LAYER_PROFILE_POWER + 1.0) * courantNumber * -std::log(LAYER_REFLECTION) / (2.0 * f64(thickness));
+					auto set = [&](i64 array, f64 depth) {
+						decay[array * layerCellCount + cell] = Scalar(std::exp(-maxDampingDt * std::pow(depth, LAYER_PROFILE_POWER)));
+					};
+					for (i64 i = 0; i < 3; i++) {
+						const auto offset = f64(i - 1) * 0.5;
+						set(i, depth(f64(x) + offset, sizeX, layers.left, layers.right));
+						set(3 + i, depth(f64(y) + offset, sizeY, layers.bottom, layers.top));
+					}
+				}
+			}
+		}
+	});
+}
+
+void WaveSolver::clearReflectingEdges(WaveField& field) const {
+	const auto sizeX = field.sizeX;
+	const auto sizeY = field.sizeY;
+	const auto elementSize = waveStorageFormatSize(field.format);
+	auto clearCell = [&](i64 x, i64 y) {
+		if (!field.isCellStored(x, y)) {
+			return;
+		}
+		const auto offset = field.cellIndex(x, y) * elementSize;
+		std::fill_n(field.uBytes.begin() + offset, elementSize, 0);
+		std::fill_n(field.u_prevBytes.begin() + offset, elementSize, 0);
+	};
+
+	if (!boundaryConditions.topAbsorbing) {
+		for (i64 xi = 1; xi < sizeX - 1; xi++) {
+			clearCell(xi, sizeY - 1);
+		}
+	}
+	if (!boundaryConditions.bottomAbsorbing) {
+		for (i64 xi = 1; xi < sizeX - 1; xi++) {
+			clearCell(xi, 0);
+		}
+	}
+	if (!boundaryConditions.leftAbsorbing) {
+		for (i64 yi = 0; yi < sizeY; yi++) {
+			clearCell(0, yi);
+		}
+	}
+	if (!boundaryConditions.rightAbsorbing) {
+		for (i64 yi = 0; yi < sizeY; yi++) {
+			clearCell(sizeX - 1, yi);
+		}
+	}
+}
+
+void WaveSolver::updateCoefficients(WaveField& field, const u8* material, const WaveMaterial* materials, i64 materialCount, const WaveWallSpans& walls, i64 pitch, f32 dt, f32 cellSize) {
+	const auto sizeX = field.sizeX;
+	const auto sizeY = field.sizeY;
+	resizeTiles(sizeX, sizeY);
+	this->walls = walls;
+	if (field.layout == WaveFieldLayout::TILES) {
+		findOpenWaveFieldTiles(storedFieldTiles, walls, sizeX, sizeY);
+		field.setStoredTiles(storedFieldTiles);
+	}
+	// Scaling all the coefficients doesn't disturb the quiet tiles.
+	const auto wakeChangedTiles = dt == coefficientsDt;
+	// The velocity is (u - u_prev) / dt.
+	const auto velocityRescale = coefficientsDt == 0.0f ? 1.0 : f64(dt) / coefficientsDt;
+	coefficientsDt = dt;
+
+	const auto scale = f64(dt) * dt / (f64(cellSize) * cellSize);
+	auto minCoefficient = std::numeric_limits<f64>::infinity();
+	tileMaxCoefficient.assign(tileCountX * tileCountY, 0.0f);
+	withWaveStorageType(field.format, [&]<typename T>(T) {
+		using Scalar = WaveComputeType<T>;
+		const auto u = WaveField::elements<T>(field.uBytes);
+		const auto u_prev = WaveField::elements<T>(field.u_prevBytes);
+		const auto coefficient = WaveField::elements<Scalar>(field.coefficientTableBytes);
+		const auto damping = WaveField::elements<Scalar>(field.dampingTableBytes);
+
+		// The walls keep the 0 entries. The cells of a material whose entry changed are woken like the cells that changed material.
+		std::array<Scalar, WAVE_MATERIAL_COUNT> previousCoefficient;
+		std::array<Scalar, WAVE_MATERIAL_COUNT> previousDamping;
+		std::copy_n(coefficient, WAVE_MATERIAL_COUNT, previousCoefficient.begin());
+		std::copy_n(damping, WAVE_MATERIAL_COUNT, previousDamping.begin());
+		const auto tableCount = std::min(materialCount, MAX_WAVE_MATERIAL_COUNT);
+		field.materialCount = tableCount + 1;
+		for (i64 m = 0; m < WAVE_MATERIAL_COUNT - 1; m++) {
+			coefficient[m + 1] = m < tableCount ? Scalar(materials[m].speedSquared * scale) : Scalar(0);
+			// A negative or NaN rate would make the velocity grow. Any other rate, however large, removes between none and all of it.
+			const auto rate = m < tableCount && materials[m].damping > 0.0f ? f64(materials[m].damping) : 0.0;
+			damping[m + 1] = Scalar(-std::expm1(-rate * dt));
+		}
+
+		field.forEachRun(0, 0, sizeX, sizeY, [&](i64 runX, i64 y, i64 runIndex, i64 runCount) {
+			// The first wall of the run is searched for and the rest are passed in order along with the cells.
+			const auto rowWallsEnd = walls.spans.begin() + walls.rowOffsets[y + 1];
+			auto wall = std::upper_bound(walls.spans.begin() + walls.rowOffsets[y], rowWallsEnd, runX, [](i64 x, const WaveWallSpans::Span& span) {
+				return x < span.end;
+			}) - walls.spans.begin();
+			for (i64 x = runX; x < runX + runCount; x++) {
+				const auto i = runIndex + x - runX;
+				const auto input = y * pitch + x;
+				const auto tile = (y / tileSize) * tileCountX + x / tileSize;
+				while (wall < walls.rowOffsets[y + 1] && walls.spans[wall].end <= x) {
+					wall++;
+				}
+				u8 index;
+				if (wall < walls.rowOffsets[y + 1] && walls.spans[wall].begin <= x) {
+					// Dirichlet boundary conditions
+					index = WAVE_WALL_MATERIAL;
+					u[i] = storeWaveValue<T>(0);
+					u_prev[i] = storeWaveValue<T>(0);
+				} else {
+					index = u8(material[input] + 1);
+					const auto value = coefficient[index];
+					minCoefficient = std::min(minCoefficient, f64(value));
+					tileMaxCoefficient[tile] = std::max(tileMaxCoefficient[tile], f32(value));
+					if (velocityRescale != 1.0) {
+						const auto uI = loadWaveValue(u[i]);
+						u_prev[i] = storeWaveValue<T>(uI - (uI - loadWaveValue(u_prev[i])) * Scalar(velocityRescale));
+					}
+				}
+				const auto previous = field.materials[i];
+				const auto coefficientChanged = previousCoefficient[previous] != coefficient[index];
+				if (coefficientChanged) {
+					implicitEliminationOutdated = true;
+					layerDecayOutdated = true;
+				}
+				if ((coefficientChanged || previousDamping[previous] != damping[index]) && wakeChangedTiles) {
+					tileAwake[tile] = true;
+				}
+				field.materials[i] = index;
+			}
+		});
+	});
+	minCourantNumber = f32(std::sqrt(minCoefficient));
+
+	dampingSpans.clear();
+	dampingSpansOffsets.assign(1, 0);
+	withWaveStorageType(field.format, [&]<typename T>(T) {
+		const auto damping = WaveField::elements<WaveComputeType<T>>(field.dampingTableBytes);
+		for (i64 y = 0; y < sizeY; y++) {
+			for (i64 x = 1; x < sizeX - 1 && y >= 1 && y < sizeY - 1; x++) {
+				if (damping[field.materialAt(x, y)] == 0) {
+					continue;
+				}
+				const auto rowHasSpans = i64(dampingSpans.size()) > dampingSpansOffsets.back();
+				if (rowHasSpans && dampingSpans.back().end == x) {
+					dampingSpans.back().end = x + 1;
+				} else {
+					dampingSpans.push_back(CellSpan{ .begin = x, .end = x + 1 });
+				}
+			}
+			dampingSpansOffsets.push_back(dampingSpans.size());
+		}
+	});
+
+	lowOrderSpans.clear();
+	lowOrderSpansOffsets.clear();
+	if (WAVE_STENCIL_RADIUS == 1) {
+		return;
+	}
+	// The cells closer than WAVE_STENCIL_RADIUS to a wall along an axis are covered by the walls of the rows that close above and below and by the walls of the row widened on both sides. The walls of the row itself are cut out.
+	const auto reach = WAVE_STENCIL_RADIUS - 1;
+	std::vector<CellSpan> nearWalls;
+	lowOrderSpansOffsets.push_back(0);
+	for (i64 y = 0; y < sizeY; y++) {
+		nearWalls.clear();
+		for (i64 wallY = std::max(y - reach, i64(0)); wallY <= std::min(y + reach, sizeY - 1); wallY++) {
+			const auto widening = wallY == y ? reach : 0;
+			for (i64 i = walls.rowOffsets[wallY]; i < walls.rowOffsets[wallY + 1]; i++) {
+				nearWalls.push_back(CellSpan{ .begin = std::max(walls.spans[i].begin - widening, i64(0)), .end = std::min(walls.spans[i].end + widening, sizeX) });
+			}
+		}
+		std::sort(nearWalls.begin(), nearWalls.end(), [](const CellSpan& a, const CellSpan& b) {
+			return a.begin < b.begin;
+		});
+		auto wall = walls.rowOffsets[y];
+		// Adds the cells of the span that aren't walls. The spans come sorted and apart from each other.
+		auto addSpan = [&](CellSpan span) {
+			for (; wall < walls.rowOffsets[y + 1] && walls.spans[wall].begin < span.end; wall++) {
+				if (span.begin < walls.spans[wall].begin) {
+					lowOrderSpans.push_back(CellSpan{ .begin = span.begin, .end = walls.spans[wall].begin });
+				}
+				span.begin = std::max(span.begin, walls.spans[wall].end);
+				// The wall can also cut the next span.
+				if (walls.spans[wall].end > span.end) {
+					break;
+				}
+			}
+			if (span.begin < span.end) {
+				lowOrderSpans.push_back(span);
+			}
+		};
+		for (i64 i = 0; i < i64(nearWalls.size());) {
+			auto span = nearWalls[i];
+			for (i++; i < i64(nearWalls.size()) && nearWalls[i].begin <= span.end; i++) {
+				span.end = std::max(span.end, nearWalls[i].end);
+			}
+			addSpan(span);
+		}
+		lowOrderSpansOffsets.push_back(lowOrderSpans.size());
+	}
+}
+
+void WaveSolver::wakeCells(i64 minX, i64 minY, i64 maxX, i64 maxY) {
+	// All the tiles start awake.
+	if (tileAwake.empty()) {
+		return;
+	}
+	const auto minTileX = std::max(minX, i64(0)) / tileSize;
+	const auto minTileY = std::max(minY, i64(0)) / tileSize;
+	const auto maxTileX = std::min(maxX / tileSize, tileCountX - 1);
+	const auto maxTileY = std::min(maxY / tileSize, tileCountY - 1);
+	for (i64 tileY = minTileY; tileY <= maxTileY; tileY++) {
+		for (i64 tileX = minTileX; tileX <= maxTileX; tileX++) {
+			tileAwake[tileY * tileCountX + tileX] = true;
+		}
+	}
+}
+
+void WaveSolver::setTileSize(i64 newTileSize) {
+	if (newTileSize == tileSize) {
+		return;
+	}
+	tileSize = newTileSize;
+	// Forces resizeTiles to wake all the tiles.
+	tileCountX = 0;
+	tileCountY = 0;
+}
+
+void WaveSolver::fieldMoved() {
+	// Forces resizeTiles to wake all the tiles.
+	tileCountX = 0;
+	tileCountY = 0;
+	implicitEliminationOutdated = true;
+	layerDecayOutdated = true;
+}
+
+void WaveSolver::resizeTiles(i64 sizeX, i64 sizeY) {
+	const auto newTileCountX = (sizeX + tileSize - 1) / tileSize;
+	const auto newTileCountY = (sizeY + tileSize - 1) / tileSize;
+	if (newTileCountX == tileCountX && newTileCountY == tileCountY) {
+		return;
+	}
+	tileCountX = newTileCountX;
+	tileCountY = newTileCountY;
+	tileAwake.assign(tileCountX * tileCountY, true);
+	tileUpdated.assign(tileCountX * tileCountY, false);
+	levelSpansTileLevel.clear();
+}
+
+bool WaveSolver::updateTileRowSpans(i64 sizeX, i64 sizeY, i32 substepCount) {
+	resizeTiles(sizeX, sizeY);
+
+	// Each substep spreads the values by the stencil radius.
+	const auto reach = (i64(substepCount) * WAVE_STENCIL_RADIUS + tileSize - 1) / tileSize;
+	std::fill(tileUpdated.begin(), tileUpdated.end(), false);
+	for (i64 tileY = 0; tileY < tileCountY; tileY++) {
+		for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+			if (!tileAwake[tileY * tileCountX + tileX]) {
+				continue;
+			}
+			for (i64 y = std::max(tileY - reach, i64(0)); y <= std::min(tileY + reach, tileCountY - 1); y++) {
+				for (i64 x = std::max(tileX - reach, i64(0)); x <= std::min(tileX + reach, tileCountX - 1); x++) {
+					tileUpdated[y * tileCountX + x] = true;
+				}
+			}
+		}
+	}
+
+	tileRowSpans.clear();
+	tileRowSpansOffsets.clear();
+	tileRowSpansOffsets.push_back(0);
+	for (i64 tileY = 0; tileY < tileCountY; tileY++) {
+		for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+			if (!tileUpdated[tileY * tileCountX + tileX]) {
+				continue;
+			}
+			const auto begin = std::max(tileX * tileSize, i64(1));
+			const auto end = std::min((tileX + 1) * tileSize, sizeX - 1);
+			if (begin >= end) {
+				continue;
+			}
+			const auto rowHasSpans = i64(tileRowSpans.size()) > tileRowSpansOffsets.back();
+			if (rowHasSpans && tileRowSpans.back().end == begin) {
+				tileRowSpans.back().end = end;
+			} else {
+				tileRowSpans.push_back(CellSpan{ .begin = begin, .end = end });
+			}
+		}
+		tileRowSpansOffsets.push_back(tileRowSpans.size());
+	}
+	return !tileRowSpans.empty();
+}
+
+void WaveSolver::sleepQuietTiles(WaveField& field, const WaveStepParameters& p, i32 substepCount) {
+	if (p.tileSleepThreshold <= 0.0f) {
+		std::fill(tileAwake.begin(), tileAwake.end(), true);
+		return;
+	}
+
+	const auto sizeX = field.sizeX;
+	const auto uThreshold = p.tileSleepThreshold;
+	// u - u_prev is the amount u changes by during a substep.
+	const auto uChangeThreshold = p.tileSleepThreshold / substepCount;
+	withWaveStorageType(field.format, [&]<typename T>(T) {
+		const auto u = WaveField::elements<T>(field.uBytes);
+		const auto u_prev = WaveField::elements<T>(field.u_prevBytes);
+		threadPool.run([&](i32 threadIndex) {
+			for (i64 tileY = threadIndex; tileY < tileCountY; tileY += threadPool.threadCount()) {
+				const auto yBegin = std::max(tileY * tileSize, i64(1));
+				const auto yEnd = std::min((tileY + 1) * tileSize, field.sizeY - 1);
+				for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+					const auto tile = tileY * tileCountX + tileX;
+					if (!tileUpdated[tile]) {
+						continue;
+					}
+					const auto xBegin = std::max(tileX * tileSize, i64(1));
+					const auto xEnd = std::min((tileX + 1) * tileSize, sizeX - 1);
+					bool awake = false;
+					for (i64 y = yBegin; y < yEnd && !awake; y++) {
+						field.forEachRowRun(y, xBegin, xEnd, [&](i64, i64 index, i64 count) {
+							for (i64 i = index; i < index + count && !awake; i++) {
+								const auto uI = loadWaveValue(u[i]);
+								awake = std::abs(uI) >= uThreshold || std::abs(uI - loadWaveValue(u_prev[i])) >= uChangeThreshold;
+							}
+						});
+					}
+					tileAwake[tile] = awake;
+					if (!awake) {
+						// Stopping the tile completely keeps both buffers equal in it, so it reads the same no matter which one is current.
+						for (i64 y = yBegin; y < yEnd; y++) {
+							field.forEachRowRun(y, xBegin, xEnd, [&](i64, i64 index, i64 count) {
+								std::copy_n(u + index, count, u_prev + index);
+							});
+						}
+					}
+				}
+			}
+		});
+	});
+}
+
+i32 WaveSolver::updateTileLevels(i32 substepCount) {
+	tileLevel.assign(tileCountX * tileCountY, 0);
+	// Each level has to take whole steps during the step.
+	const auto maxLevel = std::min(maxTimeStepLevel, i32(std::countr_zero(u32(substepCount))));
+	if (maxLevel == 0 || i64(tileMaxCoefficient.size()) != tileCountX * tileCountY) {
+		return 1;
+	}
+
+	const auto maxCourantNumber = STABLE_COURANT_NUMBER_SAFETY_FACTOR * waveStencilMaxStableCourantNumber(WAVE_STENCIL_ORDER);
+	for (i64 tile = 0; tile < tileCountX * tileCountY; tile++) {
+		if (!tileUpdated[tile]) {
+			tileLevel[tile] = NOT_UPDATED_LEVEL;
+			continue;
+		}
+		// coefficient = courantNumber^2
+		const auto courantNumber = std::sqrt(tileMaxCoefficient[tile]);
+		i32 level = 0;
+		while (level < maxLevel && courantNumber * f32(2 << level) <= maxCourantNumber) {
+			level++;
+		}
+		tileLevel[tile] = u8(level);
+	}
+
+	// The memory of the layer cells is updated every substep and their stencil can't be corrected by stepLocal. The damping is computed for a single substep. So the tiles of the layers and of the damped cells and their neighbours stay at level 0.
+	std::vector<u8> staysAtLevel0(tileCountX * tileCountY, false);
+	auto markSpanTiles = [&](i64 y, i64 begin, i64 end) {
+		for (i64 tileX = begin / tileSize; tileX <= (end - 1) / tileSize; tileX++) {
+			staysAtLevel0[(y / tileSize) * tileCountX + tileX] = true;
+		}
+	};
+	for (i64 y = 0; y + 1 < i64(layerSpansOffsets.size()); y++) {
+		for (i64 spanIndex = layerSpansOffsets[y]; spanIndex < layerSpansOffsets[y + 1]; spanIndex++) {
+			markSpanTiles(y, layerSpans[spanIndex].begin, layerSpans[spanIndex].end);
+		}
+	}
+	for (i64 y = 0; y + 1 < i64(dampingSpansOffsets.size()); y++) {
+		for (i64 spanIndex = dampingSpansOffsets[y]; spanIndex < dampingSpansOffsets[y + 1]; spanIndex++) {
+			markSpanTiles(y, dampingSpans[spanIndex].begin, dampingSpans[spanIndex].end);
+		}
+	}
+	for (i64 tileY = 0; tileY < tileCountY; tileY++) {
+		for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+			if (!staysAtLevel0[tileY * tileCountX + tileX]) {
+				continue;
+			}
+			for (i64 y = std::max(tileY - 1, i64(0)); y <= std::min(tileY + 1, tileCountY - 1); y++) {
+				for (i64 x = std::max(tileX - 1, i64(0)); x <= std::min(tileX + 1, tileCountX - 1); x++) {
+					auto& level = tileLevel[y * tileCountX + x];
+					if (level != NOT_UPDATED_LEVEL) {
+						level = 0;
+					}
+				}
+			}
+		}
+	}
+
+	// The neighbouring levels can differ by at most 1. Lowering a tile can require lowering its neighbours again.
+	auto changed = true;
+	while (changed) {
+		changed = false;
+		for (i64 tileY = 0; tileY < tileCountY; tileY++) {
+			for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+				auto& level = tileLevel[tileY * tileCountX + tileX];
+				auto limitBy = [&](i64 x, i64 y) {
+					if (x < 0 || y < 0 || x >= tileCountX || y >= tileCountY) {
+						return;
+					}
+					const auto neighbour = tileLevel[y * tileCountX + x];
+					if (level != NOT_UPDATED_LEVEL && neighbour != NOT_UPDATED_LEVEL && level > neighbour + 1) {
+						level = neighbour + 1;
+						changed = true;
+					}
+				};
+				limitBy(tileX - 1, tileY);
+				limitBy(tileX + 1, tileY);
+				limitBy(tileX, tileY - 1);
+				limitBy(tileX, tileY + 1);
+			}
+		}
+	}
+
+	i32 maxUsedLevel = 0;
+	for (const auto level : tileLevel) {
+		if (level != NOT_UPDATED_LEVEL) {
+			maxUsedLevel = std::max(maxUsedLevel, i32(level));
+		}
+	}
+	return maxUsedLevel + 1;
+}
+
+void WaveSolver::updateLevelSpans(i64 sizeX, i64 sizeY, i64 pitch) {
+	const auto upToDate = levelSpansTileLevel == tileLevel
+		&& levelSpansSizeX == sizeX
+		&& i64(cellLevel.size()) == pitch * sizeY
+		&& i64(levelSpans.size()) == timeStepLevelCount
+		&& i64(levelSpans[0].cellsOffsets.size()) == sizeY + 1;
+	if (upToDate) {
+		return;
+	}
+	levelSpansTileLevel = tileLevel;
+	levelSpansSizeX = sizeX;
+
+	// The padding at the ends of the rows isn't updated.
+	cellLevel.assign(pitch * sizeY, NOT_UPDATED_LEVEL);
+	for (i64 y = 0; y < sizeY; y++) {
+		for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+			const auto begin = cellLevel.begin() + y * pitch + tileX * tileSize;
+			std::fill(begin, begin + std::min(tileSize, sizeX - tileX * tileSize), tileLevel[(y / tileSize) * tileCountX + tileX]);
+		}
+	}
+
+	levelSpans.resize(timeStepLevelCount);
+	for (auto& spans : levelSpans) {
+		spans.cells.clear();
+		spans.cellsOffsets.assign(1, 0);
+		spans.interfaceReads.clear();
+		spans.interfaceReadsOffsets.assign(1, 0);
+	}
+	const auto r = WAVE_STENCIL_RADIUS;
+	for (i64 y = 0; y < sizeY; y++) {
+		// The edge rows are never integrated.
+		const auto isInterior = y >= 1 && y < sizeY - 1;
+		for (i64 tileX = 0; tileX < tileCountX && isInterior; tileX++) {
+			const auto level = tileLevel[(y / tileSize) * tileCountX + tileX];
+			if (level == NOT_UPDATED_LEVEL) {
+				continue;
+			}
+			auto& spans = levelSpans[level];
+			const auto begin = std::max(tileX * tileSize, i64(1));
+			const auto end = std::min((tileX + 1) * tileSize, sizeX - 1);
+			const auto rowHasSpans = i64(spans.cells.size()) > spans.cellsOffsets.back();
+			if (rowHasSpans && spans.cells.back().end == begin) {
+				spans.cells.back().end = end;
+			} else {
+				spans.cells.push_back(CellSpan{ .begin = begin, .end = end });
+			}
+
+			for (i64 x = begin; x < end; x++) {
+				const auto i = y * pitch + x;
+				for (i64 d = 1; d <= r; d++) {
+					for (const auto neighbour : { i - d, i + d, i - d * pitch, i + d * pitch }) {
+						// The high order stencil never reaches outside of the grid.
+						if (neighbour < 0 || neighbour >= pitch * sizeY) {
+							continue;
+						}
+						const auto other = cellLevel[neighbour];
+						if (other != level && other != NOT_UPDATED_LEVEL) {
+							spans.interfaceReads.push_back(InterfaceRead{ .cell = i, .neighbour = neighbour, .distance = d });
+						}
+					}
+				}
+			}
+		}
+		for (auto& spans : levelSpans) {
+			spans.cellsOffsets.push_back(spans.cells.size());
+			spans.interfaceReadsOffsets.push_back(spans.interfaceReads.size());
+		}
+	}
+}
+
+void WaveSolver::stepLocal(WaveField& field, const WaveStepParameters& p, i32 substepCount) {
+	const auto sizeX = field.sizeX;
+	const auto sizeY = field.sizeY;
+	const auto pitch = field.pitch;
+	updateLevelSpans(sizeX, sizeY, pitch);
+	const auto sweepBand = bandSweeps[i32(field.format)];
+
+	std::array<WaveStepParameters, MAX_TIME_STEP_LEVEL + 1> levelParameters;
+	for (i32 level = 0; level < timeStepLevelCount; level++) {
+		const auto ratio = f32(1 << level);
+		levelParameters[level] = WaveStepParameters{
+			.dt = p.dt * ratio,
+			.uDampingScale = std::pow(p.uDampingScale, ratio),
+			.u_tDampingScale = std::pow(p.u_tDampingScale, ratio),
+			.tileSleepThreshold = p.tileSleepThreshold,
+		};
+	}
+
+	// Matches the split done by Band::forEachStencilSpan.
+	const auto r = WAVE_STENCIL_RADIUS;
+	auto usesHighOrderStencil = [&](i64 x, i64 y) {
+		if (r == 1 || y <= r || y >= sizeY - 1 - r || x <= r || x >= sizeX - 1 - r) {
+			return false;
+		}
+		if (i64(lowOrderSpansOffsets.size()) != sizeY + 1) {
+			return true;
+		}
+		for (i64 i = lowOrderSpansOffsets[y]; i < lowOrderSpansOffsets[y + 1]; i++) {
+			if (x >= lowOrderSpans[i].begin && x < lowOrderSpans[i].end) {
+				return false;
+			}
+		}
+		return true;
+	};
+	static constexpr auto stencilWeights = waveStencilWeights<WAVE_STENCIL_ORDER>();
+
+	withWaveStorageType(field.format, [&]<typename T>(T) {
+		using Scalar = WaveComputeType<T>;
+		T* const buffers[2]{ WaveField::elements<T>(field.uBytes), WaveField::elements<T>(field.u_prevBytes) };
+		const auto coefficient = WaveField::elements<Scalar>(field.coefficientTableBytes);
+
+		threadPool.run([&](i32 threadIndex) {
+			const auto conditions = boundaryConditions;
+			const auto threadCount = threadPool.threadCount();
+			const auto rowBegin = 1 + (sizeY - 2) * threadIndex / threadCount;
+			const auto rowEnd = 1 + (sizeY - 2) * (threadIndex + 1) / threadCount;
+			// The buffer the u of each level is in. Every thread keeps its own copy.
+			std::array<i64, MAX_TIME_STEP_LEVEL + 1> levelBuffer{};
+
+			const auto levelOf = cellLevel.data();
+			for (i64 substep = 0; substep < substepCount; substep++) {
+				for (i32 level = timeStepLevelCount - 1; level >= 0; level--) {
+					const auto ratio = i64(1) << level;
+					if (substep % ratio != 0) {
+						continue;
+					}
+
+					const auto& levelP = levelParameters[level];
+					const auto current = levelBuffer[level];
+
+					// The sweep reads the cells of the other levels from the buffer of this level. The cells whose stencil reaches them are corrected by the difference their actual values make. A coarser cell is newest * weight + previous * (1 - weight) and a finer one is newest. The finer levels haven't been advanced yet during this substep. The cells of this level and the ones that aren't updated are read from the level's buffer, so they add 0.
+					std::array<const T*, NOT_UPDATED_LEVEL + 1> newest;
+					std::array<const T*, NOT_UPDATED_LEVEL + 1> previous;
+					std::array<Scalar, NOT_UPDATED_LEVEL + 1> weight;
+					for (i32 other = 0; other <= NOT_UPDATED_LEVEL; other++) {
+						const auto isCoarser = other > level && other < timeStepLevelCount;
+						const auto buffer = other < timeStepLevelCount && other != level ? levelBuffer[other] : current;
+						newest[other] = buffers[buffer];
+						previous[other] = isCoarser ? buffers[1 - buffer] : buffers[buffer];
+						// How far into its current step the coarser level is.
+						weight[other] = isCoarser ? Scalar(substep % (i64(1) << other)) / Scalar(i64(1) << other) : Scalar(1);
+					}
+					auto readCorrection = [&](i64 i) {
+						const auto other = levelOf[i];
+						return loadWaveValue(newest[other][i]) * weight[other] + loadWaveValue(previous[other][i]) * (Scalar(1) - weight[other]) - loadWaveValue(buffers[current][i]);
+					};
+
+					const auto next = buffers[1 - current];
+					const auto scale = Scalar(levelP.uDampingScale);
+					const auto laplacianScale = scale * Scalar(ratio * ratio);
+					const auto absorbingScale = scale * Scalar(ratio);
+					const auto& spans = levelSpans[level];
+					auto correctInterface = [&](i64 y) {
+						for (i64 readIndex = spans.interfaceReadsOffsets[y]; readIndex < spans.interfaceReadsOffsets[y + 1]; readIndex++) {
+							const auto& read = spans.interfaceReads[readIndex];
+							const auto i = read.cell;
+							const auto x = i - y * pitch;
+							// The cells next to the absorbing edges only read the neighbour further from the edge, the last one set by Band::advance.
+							i64 inside = -1;
+							if (conditions.bottomAbsorbing && y == 1) {
+								inside = i + pitch;
+							}
+							if (conditions.topAbsorbing && y == sizeY - 2) {
+								inside = i - pitch;
+							}
+							if (conditions.leftAbsorbing && x == 1) {
+								inside = i + 1;
+							}
+							if (conditions.rightAbsorbing && x == sizeX - 2) {
+								inside = i - 1;
+							}
+
+							const auto coefficientI = coefficient[field.materials[i]];
+							Scalar scaledWeight;
+							if (inside != -1) {
+								if (read.neighbour != inside) {
+									continue;
+								}
+								scaledWeight = std::sqrt(coefficientI) * absorbingScale;
+							} else if (usesHighOrderStencil(x, y)) {
+								scaledWeight = Scalar(stencilWeights[read.distance]) * coefficientI * laplacianScale;
+							} else if (read.distance == 1) {
+								scaledWeight = coefficientI * laplacianScale;
+							} else {
+								continue;
+							}
+							next[i] = storeWaveValue<T>(loadWaveValue(next[i]) + readCorrection(read.neighbour) * scaledWeight);
+						}
+					};
+
+					// The rows are corrected soon after they are swept, while they are still in the cache.
+					for (i64 chunkBegin = rowBegin; chunkBegin < rowEnd; chunkBegin += LOCAL_TIME_STEP_CHUNK_ROWS) {
+						const auto chunkEnd = std::min(chunkBegin + LOCAL_TIME_STEP_CHUNK_ROWS, rowEnd);
+						const Band band{
+							.solver = *this,
+							.field = field,
+							.p = levelP,
+							.rowBegin = chunkBegin,
+							.rowEnd = chunkEnd,
+							.haloSize = 0,
+							.halo = nullptr,
+							.firstSubstep = current,
+							.levelSpans = &spans,
+							.substepRatio = f32(ratio),
+							// Between the steps u_prev is from one substep of level 0 ago.
+							.u_prevAge = substep == 0 ? 1.0f / f32(ratio) : 1.0f,
+						};
+						sweepBand(band, 1);
+						for (i64 y = chunkBegin; y < chunkEnd; y++) {
+							correctInterface(y);
+						}
+					}
+					// The next pass reads the cells written by the other threads.
+					threadPool.barrier();
+					levelBuffer[level] = 1 - levelBuffer[level];
+				}
+			}
+
+			// Level 0 takes an even number of substeps, so it ends with u in buffer 0. Moves u of the other levels there too and u_prev back to one substep of level 0 ago.
+			for (i32 level = 1; level < timeStepLevelCount; level++) {
+				const auto ratio = Scalar(1 << level);
+				const auto& spans = levelSpans[level];
+				for (i64 y = rowBegin; y < rowEnd; y++) {
+					for (i64 spanIndex = spans.cellsOffsets[y]; spanIndex < spans.cellsOffsets[y + 1]; spanIndex++) {
+						const auto begin = y * pitch + spans.cells[spanIndex].begin;
+						const auto end = y * pitch + spans.cells[spanIndex].end;
+						if (levelBuffer[level] == 0) {
+							const auto u = buffers[0];
+							const auto u_prev = buffers[1];
+							for (i64 i = begin; i < end; i++) {
+								const auto uI = loadWaveValue(u[i]);
+								u_prev[i] = storeWaveValue<T>(uI - (uI - loadWaveValue(u_prev[i])) / ratio);
+							}
+						} else {
+							// u is in buffer 1 and u_prev in buffer 0.
+							const auto uAndNewU_prev = buffers[1];
+							const auto u_prevAndNewU = buffers[0];
+							for (i64 i = begin; i < end; i++) {
+								const auto uI = loadWaveValue(uAndNewU_prev[i]);
+								const auto u_prevI = loadWaveValue(u_prevAndNewU[i]);
+								u_prevAndNewU[i] = storeWaveValue<T>(uI);
+								uAndNewU_prev[i] = storeWaveValue<T>(uI - (uI - u_prevI) / ratio);
+							}
+						}
+					}
+				}
+			}
+		});
+	});
+}
+
+// Copies the cells of the rows [rowBegin, rowEnd) and the columns [columnBegin, columnEnd) of from to the transposed array to. The rows of from are fromRowLength cells apart and the rows of to toRowLength. The rows are copied in blocks, so the cache lines of a block are reused for all of its columns.
+template<typename T>
+static void transposeCells(T* to, const T* from, i64 fromRowLength, i64 toRowLength, i64 columnBegin, i64 columnEnd, i64 rowBegin, i64 rowEnd) {
+	for (i64 blockBegin = rowBegin; blockBegin < rowEnd; blockBegin += WaveSolver::TRANSPOSE_BLOCK_SIZE) {
+		const auto blockEnd = std::min(blockBegin + WaveSolver::TRANSPOSE_BLOCK_SIZE, rowEnd);
+		for (i64 column = columnBegin; column < columnEnd; column++) {
+			for (i64 row = blockBegin; row < blockEnd; row++) {
+				to[column * toRowLength + row] = from[row * fromRowLength + column];
+			}
+		}
+	}
+}
+
+void WaveSolver::stepImplicit(WaveField& field, const WaveStepParameters& p, i32 substepCount) {
+	const auto sizeX = field.sizeX;
+	const auto sizeY = field.sizeY;
+	const auto pitch = field.pitch;
+	auto conditions = boundaryConditions;
+	conditions.topAbsorbing |= perfectlyMatchedLayers.top;
+	conditions.bottomAbsorbing |= perfectlyMatchedLayers.bottom;
+	conditions.leftAbsorbing |= perfectlyMatchedLayers.left;
+	conditions.rightAbsorbing |= perfectlyMatchedLayers.right;
+	// The cells next to the absorbing edges aren't part of the systems. Their w is treated as 0 and they are updated after the others.
+	const auto xBegin = i64(conditions.leftAbsorbing ? 2 : 1);
+	const auto xEnd = sizeX - (conditions.rightAbsorbing ? 2 : 1);
+	const auto yBegin = i64(conditions.bottomAbsorbing ? 2 : 1);
+	const auto yEnd = sizeY - (conditions.topAbsorbing ? 2 : 1);
+	if (xBegin >= xEnd || yBegin >= yEnd) {
+		return;
+	}
+
+	withWaveStorageType(field.format, [&]<typename T>(T) {
+		using Scalar = WaveComputeType<T>;
+		// The arrays along the rows of the grid have its pitch.
+		const auto bytes = pitch * sizeY * i64(sizeof(Scalar));
+		if (i64(implicitW.size()) != bytes) {
+			implicitEliminationOutdated = true;
+		}
+		for (auto array : {
+			&implicitW, &implicitWTransposed, &implicitCourant,
+			&implicitEliminationX.lower, &implicitEliminationX.inversePivot, &implicitEliminationX.upper,
+			&implicitEliminationY.lower, &implicitEliminationY.inversePivot, &implicitEliminationY.upper }) {
+			array->resize(bytes);
+		}
+		implicitZeros.assign(std::max(sizeX, sizeY) * sizeof(Scalar), 0);
+		const auto w = WaveField::elements<Scalar>(implicitW);
+		const auto wTransposed = WaveField::elements<Scalar>(implicitWTransposed);
+		const auto courant = WaveField::elements<Scalar>(implicitCourant);
+		const auto zeros = WaveField::elements<Scalar>(implicitZeros);
+		const auto coefficient = WaveField::elements<Scalar>(field.coefficientTableBytes);
+		const auto damping = WaveField::elements<Scalar>(field.dampingTableBytes);
+		T* const buffers[2]{ WaveField::elements<T>(field.uBytes), WaveField::elements<T>(field.u_prevBytes) };
+
+		struct Elimination {
+			Scalar* lower;
+			Scalar* inversePivot;
+			Scalar* upper;
+		};
+		auto elimination = [](ImplicitElimination& e) {
+			return Elimination{ WaveField::elements<Scalar>(e.lower), WaveField::elements<Scalar>(e.inversePivot), WaveField::elements<Scalar>(e.upper) };
+		};
+		// The x arrays are transposed like wTransposed.
+		const auto eliminationX = elimination(implicitEliminationX);
+		const auto eliminationY = elimination(implicitEliminationY);
+
+		// Eliminates the system w - theta * C * (C[-1] * w[-1] - 2 * C * w + C[+1] * w[+1]) = rhs at index i, where the previous cell of the system is stride before it.
+		auto eliminate = [](const Elimination& e, const Scalar* c, i64 i, i64 stride, bool first, bool last) {
+			const auto previousCourant = first ? 0.0 : f64(c[i - stride]);
+			const auto nextCourant = last ? 0.0 : f64(c[i + stride]);
+			const auto previousUpper = first ? 0.0 : f64(e.upper[i - stride]);
+			const auto lower = IMPLICIT_THETA * c[i] * previousCourant;
+			const auto pivot = 1.0 + 2.0 * IMPLICIT_THETA * c[i] * c[i] - lower * previousUpper;
+			e.inversePivot[i] = Scalar(1.0 / pivot);
+			e.lower[i] = Scalar(lower / pivot);
+			e.upper[i] = Scalar(-IMPLICIT_THETA * c[i] * nextCourant / pivot);
+		};
+
+		const auto updateElimination = implicitEliminationOutdated;
+		implicitEliminationOutdated = false;
+
+		const auto uDampingScale = Scalar(p.uDampingScale);
+		const auto uScale = Scalar(p.uDampingScale + p.u_tDampingScale);
+		const auto u_prevScale = Scalar(p.uDampingScale * p.u_tDampingScale);
+
+		threadPool.run([&](i32 threadIndex) {
+			const auto threadCount = i64(threadPool.threadCount());
+			// Each thread solves the systems along x of its rows and the systems along y of its columns.
+			const auto rowBegin = yBegin + (yEnd - yBegin) * threadIndex / threadCount;
+			const auto rowEnd = yBegin + (yEnd - yBegin) * (threadIndex + 1) / threadCount;
+			const auto columnBegin = xBegin + (xEnd - xBegin) * threadIndex / threadCount;
+			const auto columnEnd = xBegin + (xEnd - xBegin) * (threadIndex + 1) / threadCount;
+			const auto rowCount = rowEnd - rowBegin;
+			const auto columnCount = columnEnd - columnBegin;
+
+			if (updateElimination) {
+				for (i64 y = rowBegin; y < rowEnd; y++) {
+					for (i64 x = xBegin; x < xEnd; x++) {
+						courant[y * pitch + x] = std::sqrt(coefficient[field.materials[y * pitch + x]]);
+					}
+				}
+				threadPool.barrier();
+
+				for (i64 y = yBegin; y < yEnd; y++) {
+					for (i64 x = columnBegin; x < columnEnd; x++) {
+						eliminate(eliminationY, courant, y * pitch + x, pitch, y == yBegin, y == yEnd - 1);
+					}
+				}
+				// The transposed courant numbers are only needed here, so they are kept in wTransposed.
+				transposeCells(wTransposed, courant, pitch, sizeY, columnBegin, columnEnd, yBegin, yEnd);
+				threadPool.barrier();
+				for (i64 x = xBegin; x < xEnd; x++) {
+					for (i64 y = rowBegin; y < rowEnd; y++) {
+						eliminate(eliminationX, wTransposed, x * sizeY + y, sizeY, x == xBegin, x == xEnd - 1);
+					}
+				}
+				threadPool.barrier();
+			}
+
+			// Solves the systems along y in the columns of the thread. Row k of the arrays of the systems along y is the row k of the grid.
+			auto solveY = [&](auto&& rowDone) {
+				for (i64 y = yBegin; y < yEnd; y++) {
+					const auto i = y * pitch + columnBegin;
+					waveTridiagonalEliminationRow<T>(w + i, y == yBegin ? zeros : w + i - pitch, eliminationY.lower + i, eliminationY.inversePivot + i, columnCount);
+				}
+				// A row is final once it is substituted, because the row above it already is.
+				for (i64 y = yEnd - 1; y >= yBegin; y--) {
+					const auto i = y * pitch + columnBegin;
+					waveTridiagonalSubstitutionRow<T>(w + i, y == yEnd - 1 ? zeros : w + i + pitch, eliminationY.upper + i, columnCount);
+					rowDone(i);
+				}
+			};
+
+			for (i64 substep = 0; substep < substepCount; substep++) {
+				const auto u = buffers[substep % 2];
+				const auto next = buffers[1 - substep % 2];
+
+				for (i64 y = rowBegin; y < rowEnd; y++) {
+					const auto i = y * pitch + xBegin;
+					const T* const uRows[]{ u + i - pitch, u + i, u + i + pitch };
+					waveLaplacianRow<T>(w + i, uRows + 1, courant + i, xEnd - xBegin);
+				}
+				threadPool.barrier();
+
+				solveY([](i64) {});
+				transposeCells(wTransposed, w, pitch, sizeY, columnBegin, columnEnd, yBegin, yEnd);
+				threadPool.barrier();
+
+				// Row x of the transposed array holds the cell x of the systems along x.
+				for (i64 x = xBegin; x < xEnd; x++) {
+					const auto i = x * sizeY + rowBegin;
+					waveTridiagonalEliminationRow<T>(wTransposed + i, x == xBegin ? zeros : wTransposed + i - sizeY, eliminationX.lower + i, eliminationX.inversePivot + i, rowCount);
+				}
+				for (i64 x = xEnd - 1; x >= xBegin; x--) {
+					const auto i = x * sizeY + rowBegin;
+					waveTridiagonalSubstitutionRow<T>(wTransposed + i, x == xEnd - 1 ? zeros : wTransposed + i + sizeY, eliminationX.upper + i, rowCount);
+				}
+				transposeCells(w, wTransposed, sizeY, pitch, rowBegin, rowEnd, xBegin, xEnd);
+				threadPool.barrier();
+
+				solveY([&](i64 i) {
+					waveImplicitUpdateRow<T>(next + i, u + i, w + i, courant + i, uScale, u_prevScale, uDampingScale, columnCount);
+					const auto y = i / pitch;
+					dampRow(*this, next + i, u + i, field.materials.data() + i, damping, field.materialCount, uDampingScale, y, columnBegin, columnEnd);
+				});
+				threadPool.barrier();
+
+				if (threadIndex == 0) {
+					auto absorb = [&](i64 i, i64 inside) {
+						const auto courantNumber = std::sqrt(coefficient[field.materials[i]]);
+						next[i] = storeWaveValue<T>((loadWaveValue(u[i]) + courantNumber * loadWaveValue(next[inside])) / (Scalar(1) + courantNumber) * uDampingScale);
+					};
+					// The edges are done in the same order as in Band::advance. The corners read the cells next to the edge done before them.
+					for (i64 x = 1; x < sizeX - 1; x++) {
+						if (conditions.bottomAbsorbing) {
+							absorb(pitch + x, 2 * pitch + x);
+						}
+						if (conditions.topAbsorbing) {
+							absorb((sizeY - 2) * pitch + x, (sizeY - 3) * pitch + x);
+						}
+					}
+					for (i64 y = 1; y < sizeY - 1; y++) {
+						if (conditions.leftAbsorbing) {
+							absorb(y * pitch + 1, y * pitch + 2);
+						}
+						if (conditions.rightAbsorbing) {
+							absorb(y * pitch + sizeX - 2, y * pitch + sizeX - 3);
+						}
+					}
+				}
+				// The next substep reads the cells written by the other threads.
+				threadPool.barrier();
+			}
+		});
+	});
+
+	if (substepCount % 2 == 1) {
+		std::swap(field.uBytes, field.u_prevBytes);
+	}
+}
+
+void WaveSolver::stepTiles(WaveField& field, const WaveStepParameters& p, i32 substepCount) {
+	auto hasUpdatedCells = [&](i64 tileX, i64 tileY) {
+		// The tiles that aren't stored are all walls.
+		if (field.tileOrigin(tileX, tileY) == WAVE_FIELD_NO_TILE) {
+			return false;
+		}
+		const auto xBegin = tileX * WAVE_FIELD_TILE_SIZE;
+		const auto xEnd = xBegin + WAVE_FIELD_TILE_SIZE;
+		const auto yBegin = std::max(tileY * WAVE_FIELD_TILE_SIZE, i64(1));
+		const auto yEnd = std::min((tileY + 1) * WAVE_FIELD_TILE_SIZE, field.sizeY - 1);
+		for (i64 spansY = yBegin / tileSize; yBegin < yEnd && spansY <= (yEnd - 1) / tileSize; spansY++) {
+			for (i64 i = tileRowSpansOffsets[spansY]; i < tileRowSpansOffsets[spansY + 1]; i++) {
+				if (tileRowSpans[i].begin < xEnd && tileRowSpans[i].end > xBegin) {
+					return true;
+				}
+			}
+		}
+		return false;
+	};
+	updatedFieldTiles.clear();
+	for (i64 tileY = 0; tileY < field.tileCountY; tileY++) {
+		for (i64 tileX = 0; tileX < field.tileCountX; tileX++) {
+			if (hasUpdatedCells(tileX, tileY)) {
+				updatedFieldTiles.push_back(tileY * field.tileCountX + tileX);
+			}
+		}
+	}
+	std::sort(updatedFieldTiles.begin(), updatedFieldTiles.end(), [&](i64 a, i64 b) {
+		return field.tileOrigins[a] < field.tileOrigins[b];
+	});
+
+	// Most tiles are away from the walls, the layers and the edges, and finding the spans of their rows would take a large part of the step.
+	auto overlapsSpans = [](const auto& spans, const std::vector<i64>& offsets, i64 y, i64 begin, i64 end) {
+		if (i64(offsets.size()) <= y + 1) {
+			return false;
+		}
+		for (i64 i = offsets[y]; i < offsets[y + 1]; i++) {
+			if (spans[i].begin < end && spans[i].end > begin) {
+				return true;
+			}
+		}
+		return false;
+	};
+	auto isUniform = [&](i64 tileX, i64 tileY) {
+		const auto r = WAVE_STENCIL_RADIUS;
+		const auto xBegin = tileX * WAVE_FIELD_TILE_SIZE;
+		const auto xEnd = xBegin + WAVE_FIELD_TILE_SIZE;
+		const auto yBegin = tileY * WAVE_FIELD_TILE_SIZE;
+		const auto yEnd = yBegin + WAVE_FIELD_TILE_SIZE;
+		if (xBegin <= r || yBegin <= r || xEnd >= field.sizeX - 1 - r || yEnd >= field.sizeY - 1 - r) {
+			return false;
+		}
+		for (i64 y = yBegin; y < yEnd; y++) {
+			if (overlapsSpans(walls.spans, walls.rowOffsets, y, xBegin, xEnd) ||
+				overlapsSpans(lowOrderSpans, lowOrderSpansOffsets, y, xBegin, xEnd) ||
+				overlapsSpans(dampingSpans, dampingSpansOffsets, y, xBegin, xEnd) ||
+				overlapsSpans(layerSpans, layerSpansOffsets, y, xBegin, xEnd)) {
+				return false;
+			}
+		}
+		// The tile has to be inside one span of awake cells in each of its rows.
+		for (i64 spansY = yBegin / tileSize; spansY <= (yEnd - 1) / tileSize; spansY++) {
+			bool covered = false;
+			for (i64 i = tileRowSpansOffsets[spansY]; i < tileRowSpansOffsets[spansY + 1]; i++) {
+				covered |= tileRowSpans[i].begin <= xBegin && tileRowSpans[i].end >= xEnd;
+			}
+			if (!covered) {
+				return false;
+			}
+		}
+		return true;
+	};
+	uniformFieldTiles.resize(updatedFieldTiles.size());
+	for (i64 i = 0; i < i64(updatedFieldTiles.size()); i++) {
+		uniformFieldTiles[i] = isUniform(updatedFieldTiles[i] % field.tileCountX, updatedFieldTiles[i] / field.tileCountX);
+	}
+
+	const auto sweepBand = bandSweeps[i32(field.format)];
+	threadPool.run([&](i32 threadIndex) {
+		// The tiles next to each other in the Z-order are close together in the grid, so each thread gets a compact region.
+		const auto threadCount = i64(threadPool.threadCount());
+		const auto tileCount = i64(updatedFieldTiles.size());
+		const auto tilesBegin = tileCount * threadIndex / threadCount;
+		const auto tilesEnd = tileCount * (threadIndex + 1) / threadCount;
+		auto copyGhostCells = [&](i64 buffer) {
+			for (i64 i = tilesBegin; i < tilesEnd; i++) {
+				const auto tile = updatedFieldTiles[i];
+				field.copyTileGhostCells(buffer == 0 ? field.uBytes : field.u_prevBytes, tile % field.tileCountX, tile / field.tileCountX);
+			}
+		};
+
+		// u could have been modified since the last step.
+		copyGhostCells(0);
+		threadPool.barrier();
+		for (i64 substep = 0; substep < substepCount; substep++) {
+			for (i64 i = tilesBegin; i < tilesEnd; i++) {
+				const auto tileX = updatedFieldTiles[i] % field.tileCountX;
+				const auto tileY = updatedFieldTiles[i] / field.tileCountX;
+				const Band band{
+					.solver = *this,
+					.field = field,
+					.p = p,
+					.rowBegin = std::max(tileY * WAVE_FIELD_TILE_SIZE, i64(1)),
+					.rowEnd = std::min((tileY + 1) * WAVE_FIELD_TILE_SIZE, field.sizeY - 1),
+					.haloSize = 0,
+					.halo = nullptr,
+					.firstSubstep = substep,
+					.tileX = tileX,
+					.tileY = tileY,
+					.columnBegin = tileX * WAVE_FIELD_TILE_SIZE,
+					.uniform = bool(uniformFieldTiles[i]),
+				};
+				sweepBand(band, 1);
+			}
+			threadPool.barrier();
+			if (substep + 1 < substepCount) {
+				// The written buffer is u during the next substep.
+				copyGhostCells(1 - substep % 2);
+				threadPool.barrier();
+			}
+		}
+	});
+
+	if (substepCount % 2 == 1) {
+		std::swap(field.uBytes, field.u_prevBytes);
+	}
+}
+
+i64 WaveSolver::temporalBlockDepth(i64 pitch, i64 elementSize, i64 bandRowCount, i32 substepCount, i32 maxTemporalBlockDepth) const {
+	// u, u_prev and coefficient.
+	const auto rowBytes = pitch * 3 * elementSize;
+	// The block keeps about r + 1 rows of each buffer per substep in flight, where r is the stencil radius.
+	auto depth = TEMPORAL_BLOCK_CACHE_BYTES / ((WAVE_STENCIL_RADIUS + 1) * rowBytes) - 1;
+	if (threadPool.threadCount() > 1) {
+		// Every substep in the block recomputes 2 * r halo rows per band.
+		depth = std::min(depth, bandRowCount / (8 * WAVE_STENCIL_RADIUS));
+	}
+	return std::clamp(depth, i64(1), i64(std::min(substepCount, maxTemporalBlockDepth)));
+}
+
+void WaveSolver::step(WaveField& field, const WaveStepParameters& p, i32 substepCount, i32 maxTemporalBlockDepth) {
+	const auto sizeX = field.sizeX;
+	const auto sizeY = field.sizeY;
+	if (sizeX < 3 || sizeY < 3 || substepCount <= 0) {
+		return;
+	}
+
+	clearReflectingEdges(field);
+	if (!updateTileRowSpans(sizeX, sizeY, substepCount)) {
+		return;
+	}
+
+	if (alternatingDirectionImplicit) {
+		field.setLayout(WaveFieldLayout::ROWS);
+		std::fill(tileUpdated.begin(), tileUpdated.end(), true);
+		timeStepLevelCount = 1;
+		stepImplicit(field, p, substepCount);
+		sleepQuietTiles(field, p, substepCount);
+		return;
+	}
+
+	updatePerfectlyMatchedLayers(field);
+	if (field.layout == WaveFieldLayout::TILES) {
+		timeStepLevelCount = 1;
+		stepTiles(field, p, substepCount);
+		sleepQuietTiles(field, p, substepCount);
+		return;
+	}
+	timeStepLevelCount = updateTileLevels(substepCount);
+	if (timeStepLevelCount > 1) {
+		stepLocal(field, p, substepCount);
+		sleepQuietTiles(field, p, substepCount);
+		return;
+	}
+
+	const auto elementSize = waveStorageFormatSize(field.format);
+	const auto sweepBand = bandSweeps[i32(field.format)];
+	const auto interiorRowCount = sizeY - 2;
+	const auto bandCount = std::clamp(interiorRowCount / MIN_ROWS_PER_BAND, i64(1), i64(threadPool.threadCount()));
+	const auto depth = temporalBlockDepth(field.pitch, elementSize, interiorRowCount / bandCount, substepCount, maxTemporalBlockDepth);
+
+	if (bandCount == 1) {
+		for (i64 substep = 0; substep < substepCount; substep += depth) {
+			sweepBand(Band{ .solver = *this, .field = field, .p = p, .rowBegin = 1, .rowEnd = sizeY - 1, .haloSize = 1, .halo = nullptr, .firstSubstep = substep }, std::min(depth, substepCount - substep));
+		}
+	} else {
+		bandHalos.resize(bandCount);
+		for (auto& halo : bandHalos) {
+			for (i64 buffer = 0; buffer < 2; buffer++) {
+				halo.below[buffer].resize(depth * WAVE_STENCIL_RADIUS * field.pitch * elementSize);
+				halo.above[buffer].resize(depth * WAVE_STENCIL_RADIUS * field.pitch * elementSize);
+			}
+		}
+
+		threadPool.run([&](i32 threadIndex) {
+			const auto bandIndex = i64(threadIndex);
+			for (i64 substep = 0; substep < substepCount; substep += depth) {
+				const auto blockDepth = std::min(depth, substepCount - substep);
+				if (bandIndex >= bandCount) {
+					threadPool.barrier();
+					threadPool.barrier();
+					continue;
+				}
+
+				const Band band{
+					.solver = *this,
+					.field = field,
+					.p = p,
+					.rowBegin = 1 + interiorRowCount * bandIndex / bandCount,
+					.rowEnd = 1 + interiorRowCount * (bandIndex + 1) / bandCount,
+					.haloSize = blockDepth * WAVE_STENCIL_RADIUS,
+					.halo = &bandHalos[bandIndex],
+					.firstSubstep = substep,
+				};
+				// The halos have to be copied before any of the bands are modified.
+				withWaveStorageType(field.format, [&]<typename T>(T) {
+					band.copyHalo<T>();
+				});
+				threadPool.barrier();
+
+				sweepBand(band, blockDepth);
+				// The next block's halos can only be copied after all the bands are finished.
+				threadPool.barrier();
+			}
+		});
+	}
+
+	if (substepCount % 2 == 1) {
+		std::swap(field.uBytes, field.u_prevBytes);
+	}
+	sleepQuietTiles(field, p, substepCount);
+}
+
+i64 findOpenWaveFieldTiles(std::vector<u8>& open, const WaveWallSpans& walls, i64 sizeX, i64 sizeY) {
+	const auto tileCountX = (sizeX + WAVE_FIELD_TILE_SIZE - 1) / WAVE_FIELD_TILE_SIZE;
+	const auto tileCountY = (sizeY + WAVE_FIELD_TILE_SIZE - 1) / WAVE_FIELD_TILE_SIZE;
+	open.assign(tileCountX * tileCountY, false);
+	i64 openCount = 0;
+	for (i64 y = 0; y < sizeY; y++) {
+		const auto tileY = y / WAVE_FIELD_TILE_SIZE;
+		auto wall = walls.rowOffsets[y];
+		for (i64 tileX = 0; tileX < tileCountX; tileX++) {
+			const auto begin = tileX * WAVE_FIELD_TILE_SIZE;
+			const auto end = std::min(begin + WAVE_FIELD_TILE_SIZE, sizeX);
+			while (wall < walls.rowOffsets[y + 1] && walls.spans[wall].end <= begin) {
+				wall++;
+			}
+			// The spans are joined, so a single one has to cover the row of the tile.
+			const auto covered = wall < walls.rowOffsets[y + 1] && walls.spans[wall].begin <= begin && walls.spans[wall].end >= end;
+			auto& tile = open[tileY * tileCountX + tileX];
+			if (!covered && !tile) {
+				tile = true;
+				openCount++;
+			}
+		}
+	}
+	return openCount;
+}
+
+StableSubsteps stableSubstepCount(const u8* material, const WaveMaterial* materials, i64 materialCount, const WaveWallSpans& walls, i64 sizeX, i64 sizeY, i64 pitch, f32 dt, f32 cellSize, i32 maxCount) {
+	std::array<bool, WAVE_MATERIAL_COUNT> used{};
+	for (i64 y = 0; y < sizeY; y++) {
+		// Goes through the cells between the walls of the row.
+		i64 x = 0;
+		for (i64 i = walls.rowOffsets[y]; i <= walls.rowOffsets[y + 1]; i++) {
+			const auto gapEnd = i < walls.rowOffsets[y + 1] ? std::min(walls.spans[i].begin, sizeX) : sizeX;
+			for (; x < gapEnd; x++) {
+				used[material[y * pitch + x]] = true;
+			}
+			if (i < walls.rowOffsets[y + 1]) {
+				x = std::max(x, walls.spans[i].end);
+			}
+		}
+	}
+	f32 maxSpeedSquared = 0.0f;
+	for (i64 m = 0; m < materialCount && m < WAVE_MATERIAL_COUNT; m++) {
+		if (used[m]) {
+			maxSpeedSquared = std::max(maxSpeedSquared, materials[m].speedSquared);
+		}
+	}
+
+	const auto maxCourantNumber = STABLE_COURANT_NUMBER_SAFETY_FACTOR * waveStencilMaxStableCourantNumber(WAVE_STENCIL_ORDER);
+	// speed * (dt / count) / cellSize <= maxCourantNumber
+	const auto count = std::ceil(std::sqrt(maxSpeedSquared) * dt / (cellSize * maxCourantNumber));
+	if (count > maxCount) {
+		return StableSubsteps{ .count = maxCount, .stable = false };
+	}
+	return StableSubsteps{ .count = std::max(i32(count), 1), .stable = true };
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <Types.hpp>
+#include <game/ThreadPool.hpp>
+#include <game/WaveField.hpp>
+#include <game/WaveStencil.hpp>
+#include <array>
+#include <limits>
+#include <vector>
+
+// The walls as runs of cells along the rows.
+struct WaveWallSpans {
+	struct Span {
+		i64 begin;
+		i64 end;
+	};
+
+	// Removes the spans and sets the number of rows.
+	void clear(i64 sizeY);
+	// Adds the cells of row y in [begin, end). The spans can be added in any order and can overlap.
+	void add(i64 y, i64 begin, i64 end);
+	// Sorts and joins the added spans. Has to be called before the spans are read.
+	void merge();
+	bool isWall(i64 x, i64 y) const;
+
+	// The spans of row y are [rowOffsets[y], rowOffsets[y + 1]).
+	std::vector<Span> spans;
+	std::vector<i64> rowOffsets;
+
+private:
+	struct RowSpan {
+		i64 y;
+		Span span;
+	};
+	std::vector<RowSpan> added;
+};
+
+// The cells on the edges of the grid are never integrated.
+// The velocity isn't stored. It is (u - u_prev) / dt, where u_prev is u from the previous substep.
+struct WaveStepParameters {
+	// Per substep.
+	f32 dt;
+	// Applied after each substep.
+	f32 uDampingScale;
+	f32 u_tDampingScale;
+
+	// 0 disables sleeping.
+	f32 tileSleepThreshold;
+};
+
+struct WaveMaterial {
+	f32 speedSquared;
+	// The rate the velocity decays at.
+	f32 damping;
+
+	bool operator==(const WaveMaterial&) const = default;
+};
+// Material WAVE_WALL_MATERIAL of the field is reserved for the walls.
+constexpr i64 MAX_WAVE_MATERIAL_COUNT = WAVE_MATERIAL_COUNT - 1;
+
+// The sides that aren't absorbing are reflecting. The reflecting edges are kept at zero.
+struct WaveBoundaryConditions {
+	bool topAbsorbing;
+	bool bottomAbsorbing;
+	bool leftAbsorbing;
+	bool rightAbsorbing;
+
+	bool operator==(const WaveBoundaryConditions&) const = default;
+};
+
+// Absorb the waves coming at any angle. The sides with a layer should be reflecting.
+struct WavePerfectlyMatchedLayers {
+	bool top;
+	bool bottom;
+	bool left;
+	bool right;
+	i64 thickness;
+
+	bool operator==(const WavePerfectlyMatchedLayers&) const = default;
+};
+
+struct WaveSolver {
+	WaveSolver();
+
+	// Leapfrog: uNext = (uScale + u_tScale) * u - uScale * u_tScale * u_prev + uScale * coefficient * laplacian(u).
+	// uNext is written over u_prev.
+	// Up to maxTemporalBlockDepth substeps are swept together.
+	void step(WaveField& field, const WaveStepParameters& p, i32 substepCount, i32 maxTemporalBlockDepth);
+
+	void setBoundaryConditions(const WaveBoundaryConditions& conditions);
+
+	// The layers are only used by the explicit steps. The implicit step makes their sides absorbing instead.
+	void setPerfectlyMatchedLayers(const WavePerfectlyMatchedLayers& layers);
+	void updatePerfectlyMatchedLayers(WaveField& field);
+
+	// The edges are never integrated, so the reflecting ones only have to be cleared once per step.
+	void clearReflectingEdges(WaveField& field) const;
+
+	// material is the index into materials of each cell. The rows of material are pitch cells apart.
+	// Has to be called again when the geometry, the materials or dt changes.
+	void updateCoefficients(WaveField& field, const u8* material, const WaveMaterial* materials, i64 materialCount, const WaveWallSpans& walls, i64 pitch, f32 dt, f32 cellSize);
+
+	// Anything that modifies u or u_prev outside of the step has to wake the modified cells. The bounds are inclusive.
+	void wakeCells(i64 minX, i64 minY, i64 maxX, i64 maxY);
+	void setTileSize(i64 tileSize);
+	void resizeTiles(i64 sizeX, i64 sizeY);
+	// Has to be called after WaveField::scroll.
+	void fieldMoved();
+	// Returns false if there is nothing to update.
+	bool updateTileRowSpans(i64 sizeX, i64 sizeY, i32 substepCount);
+	void sleepQuietTiles(WaveField& field, const WaveStepParameters& p, i32 substepCount);
+
+	i64 temporalBlockDepth(i64 pitch, i64 elementSize, i64 bandRowCount, i32 substepCount, i32 maxTemporalBlockDepth) const;
+
+	// Assigns the updated tiles their time step levels and returns the number of levels used.
+	i32 updateTileLevels(i32 substepCount);
+	void updateLevelSpans(i64 sizeX, i64 sizeY, i64 pitch);
+	void stepLocal(WaveField& field, const WaveStepParameters& p, i32 substepCount);
+
+	// Replaces C * laplacian(u) by w from (1 + theta * Y)(1 + theta * X)(1 + theta * Y) w = C * laplacian(u), where C = sqrt(coefficient).
+	// Stable for any dt, but slows down the short waves.
+	void stepImplicit(WaveField& field, const WaveStepParameters& p, i32 substepCount);
+	void stepTiles(WaveField& field, const WaveStepParameters& p, i32 substepCount);
+
+	ThreadPool threadPool;
+
+	struct Band;
+	using BandSweepFunction = void (*)(const Band& band, i64 depth);
+	WaveBoundaryConditions boundaryConditions{};
+	// The sweep for the boundary conditions, by the storage format. Picked by setBoundaryConditions.
+	std::array<BandSweepFunction, 4> bandSweeps{};
+
+	// The rows bordering a band, indexed by the buffer, 0 is u and 1 is u_prev.
+	struct BandHalo {
+		CacheLineBytes below[2];
+		CacheLineBytes above[2];
+		std::vector<u8> layerBelow;
+		std::vector<u8> layerAbove;
+	};
+	std::vector<BandHalo> bandHalos;
+
+	i64 tileSize = DEFAULT_TILE_SIZE;
+	i64 tileCountX = 0;
+	i64 tileCountY = 0;
+	std::vector<u8> tileAwake;
+	std::vector<u8> tileUpdated;
+	f32 coefficientsDt = 0.0f;
+	// The smallest speed * dt / cellSize outside of the walls, infinity if there are only walls.
+	f32 minCourantNumber = std::numeric_limits<f32>::infinity();
+
+	// The cells updated during the step.
+	struct CellSpan {
+		i64 begin;
+		i64 end;
+	};
+	std::vector<CellSpan> tileRowSpans;
+	std::vector<i64> tileRowSpansOffsets;
+	// The cells too close to a wall for the wide stencil, which use the second order laplacian.
+	std::vector<CellSpan> lowOrderSpans;
+	std::vector<i64> lowOrderSpansOffsets;
+	// The interior cells with a damping other than 0.
+	std::vector<CellSpan> dampingSpans;
+	std::vector<i64> dampingSpansOffsets;
+	WaveWallSpans walls;
+
+	// A tile of level l takes 2^l substeps at once. 0 disables local time stepping.
+	i32 maxTimeStepLevel = 0;
+	// The number of levels used by the last step.
+	i32 timeStepLevelCount = 1;
+	std::vector<f32> tileMaxCoefficient;
+	// NOT_UPDATED_LEVEL for the tiles that aren't updated.
+	std::vector<u8> tileLevel;
+	// tileLevel of the tile each cell is in.
+	std::vector<u8> cellLevel;
+	// A cell of the stencil that is in a tile of another level.
+	struct InterfaceRead {
+		i64 cell;
+		i64 neighbour;
+		i64 distance;
+	};
+	struct LevelSpans {
+		std::vector<CellSpan> cells;
+		std::vector<i64> cellsOffsets;
+		std::vector<InterfaceRead> interfaceReads;
+		std::vector<i64> interfaceReadsOffsets;
+	};
+	std::vector<LevelSpans> levelSpans;
+	// What the levelSpans were found for.
+	std::vector<u8> levelSpansTileLevel;
+	i64 levelSpansSizeX = 0;
+
+	WavePerfectlyMatchedLayers perfectlyMatchedLayers{};
+	// The cells of the layers, numbered in the order of the spans.
+	struct LayerSpan {
+		i64 begin;
+		i64 end;
+		i64 firstCell;
+	};
+	std::vector<LayerSpan> layerSpans;
+	std::vector<i64> layerSpansOffsets;
+	std::vector<i64> layerRowCells;
+	i64 layerCellCount = 0;
+	i64 layerSpansSizeX = 0;
+	// Stored in the compute type of the field's format.
+	std::vector<u8> layerDecay;
+	bool layerSpansOutdated = true;
+	bool layerDecayOutdated = true;
+
+	bool alternatingDirectionImplicit = false;
+	// The tiles of the field with the tiles layout that have updated cells.
+	std::vector<i64> updatedFieldTiles;
+	// The updatedFieldTiles without walls, edges or special cells.
+	std::vector<u8> uniformFieldTiles;
+	// Set for the tiles of the field with cells outside the walls.
+	std::vector<u8> storedFieldTiles;
+	// Used by stepImplicit.
+	std::vector<u8> implicitW;
+	std::vector<u8> implicitWTransposed;
+	std::vector<u8> implicitCourant;
+	std::vector<u8> implicitZeros;
+	// The diagonals left by the forward elimination.
+	struct ImplicitElimination {
+		std::vector<u8> lower;
+		std::vector<u8> inversePivot;
+		std::vector<u8> upper;
+	};
+	ImplicitElimination implicitEliminationX;
+	ImplicitElimination implicitEliminationY;
+	bool implicitEliminationOutdated = true;
+
+	static constexpr i64 MIN_ROWS_PER_BAND = 8;
+	static constexpr i64 TEMPORAL_BLOCK_CACHE_BYTES = 512 * 1024;
+	static constexpr i64 DEFAULT_TILE_SIZE = 32;
+	static constexpr i32 MAX_TIME_STEP_LEVEL = 3;
+	static constexpr i64 LOCAL_TIME_STEP_CHUNK_ROWS = 8;
+	static constexpr u8 NOT_UPDATED_LEVEL = MAX_TIME_STEP_LEVEL + 1;
+	static constexpr f64 LAYER_PROFILE_POWER = 3.0;
+	static constexpr f64 LAYER_REFLECTION = 1e-4;
+	static constexpr i64 LAYER_MEMORY_ARRAY_COUNT = 6;
+	static constexpr f64 IMPLICIT_THETA = 0.25;
+	static constexpr i64 TRANSPOSE_BLOCK_SIZE = 32;
+};
+
+// Sets open[tileY * tileCountX + tileX] for the WAVE_FIELD_TILE_SIZE tiles that aren't all walls. Returns how many there are.
+i64 findOpenWaveFieldTiles(std::vector<u8>& open, const WaveWallSpans& walls, i64 sizeX, i64 sizeY);
+
+struct StableSubsteps {
+	i32 count;
+	// False if even maxCount substeps are too long for the fastest speed.
+	bool stable;
+};
+
+// The fewest substeps dt can be split into and stay stable.
+StableSubsteps stableSubstepCount(const u8* material, const WaveMaterial* materials, i64 materialCount, const WaveWallSpans& walls, i64 sizeX, i64 sizeY, i64 pitch, f32 dt, f32 cellSize, i32 maxCount);
+// Rounding and the variation of the speed can make a scheme exactly at the limit unstable.
+constexpr f32 STABLE_COURANT_NUMBER_SAFETY_FACTOR = 0.9f;
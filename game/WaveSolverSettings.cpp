@@ -0,0 +1,58 @@
+#include <game/WaveSolverSettings.hpp>
+#include <Gui.hpp>
+#include <game/Shared.hpp>
+#include <game/WaveKernels.hpp>
+#include <imgui/imgui.h>
+#include <thread>
+
+static i32 maxThreadCount() {
+	return std::max(i32(std::thread::hardware_concurrency()), 1);
+}
+
+WaveSolverSettings WaveSolverSettings::makeDefault() {
+	return WaveSolverSettings{
+		.threadCount = maxThreadCount(),
+		.maxTemporalBlockDepth = 8,
+		.localTimeStepping = false,
+		.skipQuietTiles = false,
+		.tileSize = 32,
+		.tileSleepThreshold = 0.001f,
+		.storageFormat = WaveStorageFormat::F32,
+	};
+}
+
+void waveSolverSettingsGui(WaveSolverSettings& settings) {
+	ImGui::Text("kernels: %s", waveKernelsInstructionSetName());
+	if (gameBeginPropertyEditor("wave solver settings")) {
+		Gui::inputI32("threads", settings.threadCount);
+		settings.threadCount = std::clamp(settings.threadCount, 1, maxThreadCount());
+
+		Gui::inputI32("max temporal block depth", settings.maxTemporalBlockDepth);
+		settings.maxTemporalBlockDepth = std::clamp(settings.maxTemporalBlockDepth, 1, 20);
+
+		Gui::checkbox("local time stepping", settings.localTimeStepping);
+		ImGui::SetItemTooltip("Lets the regions with slow materials take longer substeps. Rounds the automatic substep count up to a power of 2.");
+		Gui::checkbox("skip quiet tiles", settings.skipQuietTiles);
+		Gui::inputI32("tile size", settings.tileSize);
+		settings.tileSize = std::clamp(settings.tileSize, 8, 256);
+		Gui::inputFloat("tile sleep threshold", settings.tileSleepThreshold);
+		settings.tileSleepThreshold = std::max(settings.tileSleepThreshold, 0.0f);
+
+		Gui::leafNodeBegin("storage format");
+		if (ImGui::BeginCombo(Gui::prependWithHashHash("storage format"), waveStorageFormatName(settings.storageFormat))) {
+			for (const auto format : { WaveStorageFormat::F32, WaveStorageFormat::F16, WaveStorageFormat::BF16, WaveStorageFormat::F64 }) {
+				const auto isSelected = format == settings.storageFormat;
+				if (ImGui::Selectable(waveStorageFormatName(format), isSelected)) {
+					settings.storageFormat = format;
+				}
+				if (isSelected) {
+					ImGui::SetItemDefaultFocus();
+				}
+			}
+			ImGui::EndCombo();
+		}
+
+		Gui::endPropertyEditor();
+	}
+	Gui::popPropertyEditor();
+}
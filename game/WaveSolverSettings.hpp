@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Types.hpp>
+#include <game/WaveField.hpp>
+
+// Settings that change how fast the wave equation is solved.
+struct WaveSolverSettings {
+	static WaveSolverSettings makeDefault();
+
+	i32 threadCount;
+	// How many substeps can be swept together. 1 disables temporal blocking.
+	i32 maxTemporalBlockDepth;
+	// Changes the result. Lets the tiles with slow materials take 2, 4 or 8 substeps at once.
+	bool localTimeStepping;
+	// Changes the result. Stops the tiles that stay below tileSleepThreshold.
+	bool skipQuietTiles;
+	i32 tileSize;
+	f32 tileSleepThreshold;
+	// Changes the result. Not used when waveStorageFormatProblem refuses it.
+	WaveStorageFormat storageFormat;
+};
+
+void waveSolverSettingsGui(WaveSolverSettings& settings);
@@ -0,0 +1,143 @@
+#include <game/WaveSolverTuning.hpp>
+#include <game/WaveSolver.hpp>
+#include <game/WaveKernels.hpp>
+#include <JsonFileIo.hpp>
+#include <Json/JsonPrinter.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+#ifdef FINAL_RELEASE
+#define WAVE_SOLVER_TUNING_PATH "waveSolverTuning.json"
+#else
+#define WAVE_SOLVER_TUNING_PATH "game/waveSolverTuning.json"
+#endif
+
+static i32 hardwareThreadCount() {
+	return std::max(i32(std::thread::hardware_concurrency()), 1);
+}
+
+static f32 measureStepSeconds(WaveSolver& solver, i64 sizeX, i64 sizeY, const WaveSolverSettings& settings) {
+	// A power of 2, so that local time stepping can use all the levels.
+	const auto substepCount = 8;
+	const auto frameCount = 30;
+	const auto dt = 1.0f / 60.0f / substepCount;
+	// speed * dt / cellSize = 0.5
+	const auto coefficient = 0.25f;
+
+	WaveField field(sizeX, sizeY, WaveStorageFormat::F32);
+	const auto material = u8(1);
+	std::fill(field.materials.begin(), field.materials.end(), material);
+	WaveField::elements<f32>(field.coefficientTableBytes)[material] = coefficient;
+	field.materialCount = material + 1;
+	// With sleeping tiles the pulse spreads over most of the grid during the measurement, so both sparse and dense fields are included.
+	const auto pulseRadius = 3;
+	for (i64 y = sizeY / 2 - pulseRadius; y <= sizeY / 2 + pulseRadius; y++) {
+		for (i64 x = sizeX / 2 - pulseRadius; x <= sizeX / 2 + pulseRadius; x++) {
+			field.setUKeepingVelocity(x, y, 1.0f);
+		}
+	}
+
+	const WaveStepParameters parameters{
+		.dt = dt,
+		.uDampingScale = 1.0f,
+		.u_tDampingScale = 1.0f,
+		.tileSleepThreshold = settings.skipQuietTiles ? settings.tileSleepThreshold : 0.0f,
+	};
+	solver.maxTimeStepLevel = settings.localTimeStepping ? WaveSolver::MAX_TIME_STEP_LEVEL : 0;
+	// Starts up the threads and puts the tiles away from the pulse to sleep.
+	solver.step(field, parameters, 1, 1);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (i32 frame = 0; frame < frameCount; frame++) {
+		solver.step(field, parameters, substepCount, settings.maxTemporalBlockDepth);
+	}
+	return std::chrono::duration<f32>(std::chrono::steady_clock::now() - start).count();
+}
+
+static WaveSolverTuning untunedWaveSolverTuning(i64 gridSizeX, i64 gridSizeY, const WaveSolverSettings& settings) {
+	return WaveSolverTuning{
+		.instructionSet = i32(waveKernels->instructionSet),
+		.hardwareThreadCount = hardwareThreadCount(),
+		.gridSizeX = i32(gridSizeX),
+		.gridSizeY = i32(gridSizeY),
+		.maxTemporalBlockDepth = settings.maxTemporalBlockDepth,
+		.localTimeStepping = settings.localTimeStepping,
+		.tileSleepThreshold = settings.skipQuietTiles ? settings.tileSleepThreshold : 0.0f,
+		.threadCount = 1,
+		.tileSize = settings.tileSize,
+	};
+}
+
+static bool measuredInSameConditions(const WaveSolverTuning& a, const WaveSolverTuning& b) {
+	return a.instructionSet == b.instructionSet &&
+		a.hardwareThreadCount == b.hardwareThreadCount &&
+		a.gridSizeX == b.gridSizeX &&
+		a.gridSizeY == b.gridSizeY &&
+		a.maxTemporalBlockDepth == b.maxTemporalBlockDepth &&
+		a.localTimeStepping == b.localTimeStepping &&
+		a.tileSleepThreshold == b.tileSleepThreshold;
+}
+
+WaveSolverTuning tuneWaveSolver(i64 gridSizeX, i64 gridSizeY, const WaveSolverSettings& settings) {
+	auto best = untunedWaveSolverTuning(gridSizeX, gridSizeY, settings);
+	auto bestSeconds = std::numeric_limits<f32>::infinity();
+
+	std::vector<i32> threadCounts;
+	for (i32 threadCount = 1; threadCount < best.hardwareThreadCount; threadCount *= 2) {
+		threadCounts.push_back(threadCount);
+	}
+	threadCounts.push_back(best.hardwareThreadCount);
+
+	std::vector<i32> tileSizes{ settings.tileSize };
+	if (settings.skipQuietTiles || settings.localTimeStepping) {
+		tileSizes = { 16, 32, 64 };
+	}
+
+	WaveSolver solver;
+	for (const auto threadCount : threadCounts) {
+		solver.threadPool.setThreadCount(threadCount);
+		for (const auto tileSize : tileSizes) {
+			solver.setTileSize(tileSize);
+			const auto seconds = measureStepSeconds(solver, gridSizeX, gridSizeY, settings);
+			if (seconds < bestSeconds) {
+				bestSeconds = seconds;
+				best.threadCount = threadCount;
+				best.tileSize = tileSize;
+			}
+		}
+	}
+	return best;
+}
+
+WaveSolverTuning loadOrTuneWaveSolver(i64 gridSizeX, i64 gridSizeY, const WaveSolverSettings& settings) {
+	const auto conditions = untunedWaveSolverTuning(gridSizeX, gridSizeY, settings);
+	std::vector<WaveSolverTuning> cached;
+	const auto json = tryLoadJsonFromFile(WAVE_SOLVER_TUNING_PATH);
+	if (json.has_value()) {
+		try {
+			for (const auto& tuningJson : json->array()) {
+				cached.push_back(fromJson<WaveSolverTuning>(tuningJson));
+			}
+		} catch (const Json::Value::Exception&) {
+			cached.clear();
+		}
+	}
+	for (const auto& tuning : cached) {
+		if (measuredInSameConditions(tuning, conditions)) {
+			return tuning;
+		}
+	}
+
+	const auto tuning = tuneWaveSolver(gridSizeX, gridSizeY, settings);
+	cached.push_back(tuning);
+	auto cachedJson = Json::Value::emptyArray();
+	for (const auto& cachedTuning : cached) {
+		cachedJson.array().push_back(toJson(cachedTuning));
+	}
+	std::ofstream file(WAVE_SOLVER_TUNING_PATH);
+	Json::print(file, cachedJson);
+	return tuning;
+}
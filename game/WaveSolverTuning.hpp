@@ -0,0 +1,9 @@
+#pragma once
+
+#include <game/WaveSolverTuningData.hpp>
+#include <game/WaveSolverSettings.hpp>
+
+// Runs a short benchmark of the solver on a grid of the given size with different thread counts and returns the fastest. The tile sizes are only compared when the settings skip the quiet tiles or use local time stepping, otherwise they don't change the step.
+WaveSolverTuning tuneWaveSolver(i64 gridSizeX, i64 gridSizeY, const WaveSolverSettings& settings);
+// The tunings are cached in a file. A tuning is only measured if none of the cached ones was measured with the same instruction set, hardware thread count, grid size and settings.
+WaveSolverTuning loadOrTuneWaveSolver(i64 gridSizeX, i64 gridSizeY, const WaveSolverSettings& settings);
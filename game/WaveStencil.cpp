@@ -0,0 +1,90 @@
+#include <game/WaveStencil.hpp>
+#include <engine/Math/Constants.hpp>
+#include <imgui/imgui.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <span>
+
+static std::span<const f64> weightsOfOrder(i32 order) {
+	static constexpr auto weights2 = waveStencilWeights<2>();
+	static constexpr auto weights4 = waveStencilWeights<4>();
+	static constexpr auto weights6 = waveStencilWeights<6>();
+	switch (order) {
+	case 4: return weights4;
+	case 6: return weights6;
+	}
+	return weights2;
+}
+
+// The stencil applied to cos(wavenumber * x) gives -symbol * cos(wavenumber * x). The exact second derivative gives wavenumber^2.
+static f64 secondDerivativeSymbol(std::span<const f64> weights, f64 wavenumber) {
+	auto result = -weights[0];
+	for (usize i = 1; i < weights.size(); i++) {
+		result -= 2.0 * weights[i] * std::cos(f64(i) * wavenumber);
+	}
+	return result;
+}
+
+f64 waveStencilMaxStableCourantNumber(i32 order) {
+	// The symbol of the laplacian is largest for the checkerboard, which the leapfrog scheme can only represent if courantNumber^2 * symbol <= 4.
+	const auto symbol = 2.0 * secondDerivativeSymbol(weightsOfOrder(order), PI<f64>);
+	return 2.0 / std::sqrt(symbol);
+}
+
+f64 waveStencilPhaseVelocityError(i32 order, f64 cellsPerWavelength, f64 courantNumber) {
+	const auto weights = weightsOfOrder(order);
+	const auto wavenumber = TAU<f64> / cellsPerWavelength;
+	// The leapfrog scheme gives sin(frequency * dt / 2) = courantNumber * sqrt(symbol) / 2.
+	auto error = [&](f64 wavenumberX, f64 wavenumberY) {
+		const auto symbol = secondDerivativeSymbol(weights, wavenumberX) + secondDerivativeSymbol(weights, wavenumberY);
+		const auto sinHalfPhase = courantNumber * std::sqrt(symbol) / 2.0;
+		if (sinHalfPhase > 1.0) {
+			return std::numeric_limits<f64>::infinity();
+		}
+		const auto numericalFrequency = 2.0 * std::asin(sinHalfPhase);
+		const auto exactFrequency = courantNumber * wavenumber;
+		return std::abs(numericalFrequency / exactFrequency - 1.0);
+	};
+	const auto diagonal = wavenumber / std::sqrt(2.0);
+	return std::max(error(wavenumber, 0.0), error(diagonal, diagonal));
+}
+
+f64 waveStencilCellsPerWavelength(i32 order, f64 courantNumber, f64 maxError) {
+	if (courantNumber > waveStencilMaxStableCourantNumber(order)) {
+		return std::numeric_limits<f64>::infinity();
+	}
+	// The error decreases with the number of cells per wavelength. 2 is the shortest wavelength the grid can represent.
+	f64 low = 2.0;
+	f64 high = 1000.0;
+	if (waveStencilPhaseVelocityError(order, high, courantNumber) > maxError) {
+		return std::numeric_limits<f64>::infinity();
+	}
+	for (i32 i = 0; i < 50; i++) {
+		const auto middle = (low + high) / 2.0;
+		if (waveStencilPhaseVelocityError(order, middle, courantNumber) > maxError) {
+			low = middle;
+		} else {
+			high = middle;
+		}
+	}
+	return high;
+}
+
+void waveStencilDispersionGui(f32 courantNumber) {
+	ImGui::Text("stencil order: %d", WAVE_STENCIL_ORDER);
+	if (!std::isfinite(courantNumber)) {
+		return;
+	}
+	const auto MAX_ERROR = 0.01;
+	ImGui::TextWrapped("Cells per wavelength needed for a %g%% phase velocity error at courant number %.3g:", MAX_ERROR * 100.0, courantNumber);
+	for (const auto order : { 2, 4, 6 }) {
+		const auto cells = waveStencilCellsPerWavelength(order, courantNumber, MAX_ERROR);
+		const auto marker = order == WAVE_STENCIL_ORDER ? " (used)" : "";
+		if (std::isfinite(cells)) {
+			ImGui::Text("order %d: %.1f%s", order, cells, marker);
+		} else {
+			ImGui::Text("order %d: unstable%s", order, marker);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <Types.hpp>
+#include <array>
+
+// The order of accuracy of the laplacian used by the wave solver, 2, 4 or 6. Set by the WAVE_STENCIL_ORDER cmake option.
+// The error of the higher orders falls off faster with the number of cells per wavelength, so the same accuracy needs a coarser grid.
+#ifndef WAVE_STENCIL_ORDER
+#define WAVE_STENCIL_ORDER 2
+#endif
+
+static_assert(WAVE_STENCIL_ORDER == 2 || WAVE_STENCIL_ORDER == 4 || WAVE_STENCIL_ORDER == 6);
+
+// How many cells the stencil reaches in each direction.
+constexpr i64 WAVE_STENCIL_RADIUS = WAVE_STENCIL_ORDER / 2;
+
+// The central difference approximation of the second derivative with spacing 1. weights[0] is the weight of the center and weights[i] is the weight of both cells i apart from it.
+template<i32 order>
+constexpr std::array<f64, order / 2 + 1> waveStencilWeights() {
+	if constexpr (order == 2) {
+		return { -2.0, 1.0 };
+	} else if constexpr (order == 4) {
+		return { -5.0 / 2.0, 4.0 / 3.0, -1.0 / 12.0 };
+	} else {
+		static_assert(order == 6);
+		return { -49.0 / 18.0, 3.0 / 2.0, -3.0 / 20.0, 1.0 / 90.0 };
+	}
+}
+
+// The leapfrog scheme with the laplacian of the given order is stable while speed * dt / cellSize is at most this.
+f64 waveStencilMaxStableCourantNumber(i32 order);
+// The relative error of the speed at which a wave with the given number of cells per wavelength moves through the grid. The larger of the errors along an axis and along a diagonal. Infinity if the scheme is unstable.
+f64 waveStencilPhaseVelocityError(i32 order, f64 cellsPerWavelength, f64 courantNumber);
+// The fewest cells per wavelength needed to keep the error of the phase velocity below maxError.
+f64 waveStencilCellsPerWavelength(i32 order, f64 courantNumber, f64 maxError);
+
+// Compares the dispersion of the orders at the given courant number.
+void waveStencilDispersionGui(f32 courantNumber);
@@ -0,0 +1,298 @@
+#include <game/WaveSolver.hpp>
+#include <game/WaveKernels.hpp>
+#include <game/CpuFeatures.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// Runs the solver on a few scenes with every instruction set, storage format and layout and compares the result with the scalar f32 rows path.
+
+const i32 FRAME_COUNT = 20;
+const i32 SUBSTEP_COUNT = 4;
+const f32 DT = 1.0f / 60.0f;
+const f32 CELL_SIZE = 1.0f;
+const f32 COURANT_NUMBER = 0.5f;
+
+struct Pulse {
+	f64 centerX;
+	f64 centerY;
+	f64 radius;
+};
+
+struct Scene {
+	i64 sizeX;
+	i64 sizeY;
+	std::vector<u8> material;
+	std::vector<WaveMaterial> materials;
+	f32 minCourantNumber;
+	WaveWallSpans walls;
+	std::vector<Pulse> pulses;
+	// The tiles of the field covered by the walls, which the tiles layout doesn't store.
+	i64 wallTileCount;
+};
+
+f32 speedSquared(f32 courantNumber) {
+	const auto speed = courantNumber * CELL_SIZE / (DT / SUBSTEP_COUNT);
+	return speed * speed;
+}
+
+// The cells in the box in the middle have slowCourantNumber.
+Scene makeScene(f32 slowCourantNumber) {
+	Scene scene{
+		.sizeX = 230,
+		.sizeY = 170,
+		.material = std::vector<u8>(230 * 170, 0),
+		.materials = {
+			WaveMaterial{ .speedSquared = speedSquared(COURANT_NUMBER), .damping = 0.0f },
+			WaveMaterial{ .speedSquared = speedSquared(slowCourantNumber), .damping = 0.0f },
+			WaveMaterial{ .speedSquared = speedSquared(COURANT_NUMBER), .damping = 4.0f },
+		},
+		.minCourantNumber = std::min(COURANT_NUMBER, slowCourantNumber),
+		.walls = {},
+		.pulses = { Pulse{ 70.0, 60.0, 5.0 }, Pulse{ 150.0, 120.0, 3.0 } },
+		.wallTileCount = 0,
+	};
+	for (i64 y = 0; y < scene.sizeY; y++) {
+		for (i64 x = 0; x < scene.sizeX; x++) {
+			auto& material = scene.material[y * scene.sizeX + x];
+			if (x > 120 && x < 170 && y > 40 && y < 110) {
+				material = 1;
+			} else if (x > 20 && x < 60 && y > 110 && y < 140) {
+				material = 2;
+			}
+		}
+	}
+
+	scene.walls.clear(scene.sizeY);
+	for (i64 y = 30; y < 90; y++) {
+		scene.walls.add(y, 90, 94);
+	}
+	for (i64 y = 130; y < 136; y++) {
+		scene.walls.add(y, 100, 200);
+	}
+	for (i64 i = 0; i < 40; i++) {
+		scene.walls.add(20 + i / 2, 30 + i, 31 + i);
+	}
+	scene.walls.merge();
+	return scene;
+}
+
+// 3 by 2 tiles with the top left one all walls. The waves stay away from the left tiles, so that the field can be scrolled by a tile to the left.
+Scene makeLargeScene() {
+	const auto tile = WAVE_FIELD_TILE_SIZE;
+	Scene scene{
+		.sizeX = 3 * tile,
+		.sizeY = 2 * tile,
+		.material = std::vector<u8>(3 * tile * 2 * tile, 0),
+		.materials = {
+			WaveMaterial{ .speedSquared = speedSquared(COURANT_NUMBER), .damping = 0.0f },
+			WaveMaterial{ .speedSquared = speedSquared(COURANT_NUMBER), .damping = 2.0f },
+		},
+		.minCourantNumber = COURANT_NUMBER,
+		.walls = {},
+		.pulses = { Pulse{ 300.0, 128.0, 5.0 }, Pulse{ 220.0, 100.0, 4.0 } },
+		.wallTileCount = 1,
+	};
+	for (i64 y = 170; y < 230; y++) {
+		for (i64 x = 250; x < 340; x++) {
+			scene.material[y * scene.sizeX + x] = 1;
+		}
+	}
+
+	scene.walls.clear(scene.sizeY);
+	for (i64 y = 0; y < tile; y++) {
+		scene.walls.add(y, 0, tile);
+	}
+	for (i64 y = 60; y < 200; y++) {
+		scene.walls.add(y, 250, 258);
+	}
+	scene.walls.merge();
+	return scene;
+}
+
+// The cells moved shiftX to the left, the ones that enter are open.
+Scene shiftedScene(const Scene& scene, i64 shiftX) {
+	auto shifted = scene;
+	std::fill(shifted.material.begin(), shifted.material.end(), u8(0));
+	shifted.walls.clear(scene.sizeY);
+	for (i64 y = 0; y < scene.sizeY; y++) {
+		std::copy(scene.material.begin() + y * scene.sizeX + shiftX, scene.material.begin() + (y + 1) * scene.sizeX, shifted.material.begin() + y * scene.sizeX);
+		for (i64 i = scene.walls.rowOffsets[y]; i < scene.walls.rowOffsets[y + 1]; i++) {
+			const auto& span = scene.walls.spans[i];
+			if (span.end > shiftX) {
+				shifted.walls.add(y, std::max(span.begin - shiftX, i64(0)), span.end - shiftX);
+			}
+		}
+	}
+	shifted.walls.merge();
+	return shifted;
+}
+
+struct SolverCase {
+	const char* name;
+	const Scene* scene;
+	i32 threadCount;
+	i32 maxTemporalBlockDepth;
+	i32 maxTimeStepLevel;
+	bool alternatingDirectionImplicit;
+	bool perfectlyMatchedLayers;
+	// The quiet tiles aren't stepped when it isn't 0.
+	f32 tileSleepThreshold;
+	// Moves the field a tile to the left halfway through. The rows can't scroll, so their result is moved at the end instead.
+	bool scrolls;
+	// The tiles layout doesn't use temporal blocking and local time stepping, so it is only compared where they are off.
+	bool tiles;
+};
+
+struct RunResult {
+	std::vector<f32> u;
+	i64 unstoredTileCount;
+};
+
+RunResult run(const SolverCase& solverCase, InstructionSet instructionSet, WaveStorageFormat format, WaveFieldLayout layout) {
+	const auto& scene = *solverCase.scene;
+	const auto sizeX = scene.sizeX;
+	const auto sizeY = scene.sizeY;
+	waveKernels = &waveKernelsFor(instructionSet);
+
+	WaveSolver solver;
+	solver.threadPool.setThreadCount(solverCase.threadCount);
+	solver.maxTimeStepLevel = solverCase.maxTimeStepLevel;
+	solver.alternatingDirectionImplicit = solverCase.alternatingDirectionImplicit;
+	solver.setBoundaryConditions(WaveBoundaryConditions{ .topAbsorbing = true, .bottomAbsorbing = false, .leftAbsorbing = true, .rightAbsorbing = false });
+	if (solverCase.perfectlyMatchedLayers) {
+		solver.setPerfectlyMatchedLayers(WavePerfectlyMatchedLayers{ .top = false, .bottom = true, .left = false, .right = true, .thickness = 8 });
+	}
+
+	WaveField field(sizeX, sizeY, format);
+	field.setLayout(layout);
+	const auto substepDt = DT / SUBSTEP_COUNT;
+	solver.updateCoefficients(field, scene.material.data(), scene.materials.data(), i64(scene.materials.size()), scene.walls, sizeX, substepDt, CELL_SIZE);
+	const auto unstoredTileCount = field.tileCountX * field.tileCountY - field.storedTileCount;
+
+	for (const auto& pulse : scene.pulses) {
+		for (i64 y = 1; y < sizeY - 1; y++) {
+			for (i64 x = 1; x < sizeX - 1; x++) {
+				const auto distanceSquared = ((x - pulse.centerX) * (x - pulse.centerX) + (y - pulse.centerY) * (y - pulse.centerY)) / (pulse.radius * pulse.radius);
+				field.setUKeepingVelocity(x, y, f32(field.uAt(x, y) + std::exp(-distanceSquared)));
+			}
+		}
+	}
+	solver.wakeCells(0, 0, sizeX - 1, sizeY - 1);
+
+	const auto scrolls = solverCase.scrolls && layout == WaveFieldLayout::TILES;
+	const auto scrolled = solverCase.scrolls ? shiftedScene(scene, WAVE_FIELD_TILE_SIZE) : Scene{};
+	const WaveStepParameters parameters{ .dt = substepDt, .uDampingScale = 0.9999f, .u_tDampingScale = 0.9999f, .tileSleepThreshold = solverCase.tileSleepThreshold };
+	for (i32 frame = 0; frame < FRAME_COUNT; frame++) {
+		if (scrolls && frame == FRAME_COUNT / 2) {
+			field.scroll(1, 0);
+			solver.fieldMoved();
+			solver.updateCoefficients(field, scrolled.material.data(), scrolled.materials.data(), i64(scrolled.materials.size()), scrolled.walls, sizeX, substepDt, CELL_SIZE);
+		}
+		solver.step(field, parameters, SUBSTEP_COUNT, solverCase.maxTemporalBlockDepth);
+	}
+
+	std::vector<f32> u(sizeX * sizeY);
+	field.loadU(u.data(), sizeX, 0, 0, sizeX, sizeY);
+	if (solverCase.scrolls && !scrolls) {
+		for (i64 y = 0; y < sizeY; y++) {
+			const auto row = u.begin() + y * sizeX;
+			std::copy(row + WAVE_FIELD_TILE_SIZE, row + sizeX, row);
+			std::fill(row + sizeX - WAVE_FIELD_TILE_SIZE, row + sizeX, 0.0f);
+		}
+	}
+	return RunResult{ .u = std::move(u), .unstoredTileCount = unstoredTileCount };
+}
+
+// The largest difference relative to the largest value of expected.
+f64 relativeDifference(const std::vector<f32>& expected, const std::vector<f32>& actual) {
+	f64 maxDifference = 0.0;
+	f64 maxValue = 0.0;
+	for (usize i = 0; i < expected.size(); i++) {
+		if (!std::isfinite(actual[i])) {
+			return INFINITY;
+		}
+		maxDifference = std::max(maxDifference, std::abs(f64(actual[i]) - f64(expected[i])));
+		maxValue = std::max(maxValue, std::abs(f64(expected[i])));
+	}
+	return maxDifference / maxValue;
+}
+
+// The 16-bit formats round every value written, so they drift from f32 over the run.
+f64 tolerance(WaveStorageFormat format) {
+	switch (format) {
+	case WaveStorageFormat::F32: return 1e-4;
+	case WaveStorageFormat::F64: return 1e-4;
+	case WaveStorageFormat::F16: return 3e-2;
+	case WaveStorageFormat::BF16: return 2e-1;
+	}
+	return 0.0;
+}
+
+int main() {
+	const auto scene = makeScene(COURANT_NUMBER);
+	const auto slowScene = makeScene(0.25f);
+	const auto largeScene = makeLargeScene();
+	const SolverCase solverCases[] = {
+		{ .name = "explicit", .scene = &scene, .threadCount = 1, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = false, .tileSleepThreshold = 0.0f, .scrolls = false, .tiles = true },
+		{ .name = "explicit 3 threads", .scene = &scene, .threadCount = 3, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = false, .tileSleepThreshold = 0.0f, .scrolls = false, .tiles = true },
+		{ .name = "temporal blocking", .scene = &scene, .threadCount = 3, .maxTemporalBlockDepth = 4, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = false, .tileSleepThreshold = 0.0f, .scrolls = false, .tiles = false },
+		{ .name = "local time stepping", .scene = &slowScene, .threadCount = 1, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 3, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = false, .tileSleepThreshold = 0.0f, .scrolls = false, .tiles = false },
+		{ .name = "alternating direction implicit", .scene = &scene, .threadCount = 1, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = true, .perfectlyMatchedLayers = false, .tileSleepThreshold = 0.0f, .scrolls = false, .tiles = false },
+		{ .name = "perfectly matched layers", .scene = &scene, .threadCount = 1, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = true, .tileSleepThreshold = 0.0f, .scrolls = false, .tiles = true },
+		{ .name = "sleeping", .scene = &scene, .threadCount = 3, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = false, .tileSleepThreshold = 1e-3f, .scrolls = false, .tiles = true },
+		{ .name = "wall tiles", .scene = &largeScene, .threadCount = 3, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = false, .tileSleepThreshold = 0.0f, .scrolls = false, .tiles = true },
+		{ .name = "scroll", .scene = &largeScene, .threadCount = 1, .maxTemporalBlockDepth = 1, .maxTimeStepLevel = 0, .alternatingDirectionImplicit = false, .perfectlyMatchedLayers = false, .tileSleepThreshold = 0.0f, .scrolls = true, .tiles = true },
+	};
+	const InstructionSet instructionSets[] = { InstructionSet::SCALAR, InstructionSet::SSE4_2, InstructionSet::AVX2, InstructionSet::AVX512 };
+	const WaveStorageFormat formats[] = { WaveStorageFormat::F32, WaveStorageFormat::F16, WaveStorageFormat::BF16, WaveStorageFormat::F64 };
+
+	i32 failedCount = 0;
+	for (const auto& solverCase : solverCases) {
+		const auto expected = run(solverCase, InstructionSet::SCALAR, WaveStorageFormat::F32, WaveFieldLayout::ROWS).u;
+		if (solverCase.tileSleepThreshold != 0.0f) {
+			// The quiet tiles have to be skipped, but the waves they miss are below the threshold.
+			auto awakeCase = solverCase;
+			awakeCase.tileSleepThreshold = 0.0f;
+			const auto difference = relativeDifference(run(awakeCase, InstructionSet::SCALAR, WaveStorageFormat::F32, WaveFieldLayout::ROWS).u, expected);
+			const auto passed = difference > 0.0 && difference <= 1e-2;
+			if (!passed) {
+				failedCount++;
+			}
+			printf("%s compared with awake: %g %s\n", solverCase.name, difference, passed ? "ok" : "FAILED");
+		}
+		for (const auto instructionSet : instructionSets) {
+			if (!isInstructionSetSupported(instructionSet)) {
+				printf("%s: %s isn't supported, skipped\n", solverCase.name, instructionSetName(instructionSet));
+				continue;
+			}
+			for (const auto format : formats) {
+				if (const auto problem = waveStorageFormatProblem(format, solverCase.scene->minCourantNumber, 1.0f)) {
+					printf("%s: %s isn't used because %s, skipped\n", solverCase.name, waveStorageFormatName(format), problem);
+					continue;
+				}
+				for (const auto layout : { WaveFieldLayout::ROWS, WaveFieldLayout::TILES }) {
+					if (layout == WaveFieldLayout::TILES && !solverCase.tiles) {
+						continue;
+					}
+					const auto result = run(solverCase, instructionSet, format, layout);
+					const auto difference = relativeDifference(expected, result.u);
+					const auto expectedUnstoredTileCount = layout == WaveFieldLayout::TILES ? solverCase.scene->wallTileCount : 0;
+					const auto passed = difference <= tolerance(format) && result.unstoredTileCount == expectedUnstoredTileCount;
+					if (!passed) {
+						failedCount++;
+					}
+					printf("%s %s %s %s: %g %s\n", solverCase.name, instructionSetName(instructionSet), waveStorageFormatName(format), waveFieldLayoutName(layout), difference, passed ? "ok" : "FAILED");
+				}
+			}
+		}
+	}
+
+	if (failedCount != 0) {
+		printf("%d failed\n", failedCount);
+		return EXIT_FAILURE;
+	}
+	printf("all passed\n");
+}